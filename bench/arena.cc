@@ -0,0 +1,52 @@
+/* ArenaAllocator regression benchmark: per-alloc cost must stay flat as the arena ages.
+ * Small blocks on purpose, so millions of allocations spread over thousands of blocks. */
+
+#include "ArenaAllocator.hh"
+#include "utils.hh"
+#include "logs.hh"
+
+int
+main()
+{
+    constexpr u32 BLOCK_SIZE = 64 * adt::SIZE_1K;
+    constexpr u32 MAX_ALLOCS = 1 << 23;
+
+    adt::ArenaAllocator arena(BLOCK_SIZE);
+    u64 sum = 0;
+    u32 done = 0;
+
+    COUT("%12s %12s %10s\n", "allocs", "blocks", "ns/alloc");
+
+    for (u32 batch = 1 << 14; done < MAX_ALLOCS; batch *= 2)
+    {
+        f64 t0 = adt::timeNowMS();
+
+        for (u32 i = 0; i < batch; i++)
+        {
+            auto* p = (u8*)arena.alloc(1, 8 + (i & 15));
+            /* grow the last allocation every now and then, like `Array::push()` does */
+            if ((i & 7) == 0) p = (u8*)arena.realloc(p, 64);
+            sum += p[0];
+        }
+
+        f64 t1 = adt::timeNowMS();
+        done += batch;
+
+        u32 nBlocks = 0;
+        ARENA_FOREACH(&arena, pB) nBlocks++;
+
+        COUT("%12u %12u %10.2f\n", done, nBlocks, (t1 - t0) * 1000000.0 / batch);
+    }
+
+    /* same again over the retained blocks */
+    arena.reset();
+    f64 t0 = adt::timeNowMS();
+    for (u32 i = 0; i < MAX_ALLOCS; i++)
+        sum += ((u8*)arena.alloc(1, 8 + (i & 15)))[0];
+    f64 t1 = adt::timeNowMS();
+    COUT("after reset: %u allocs, %.2f ns/alloc\n", MAX_ALLOCS, (t1 - t0) * 1000000.0 / MAX_ALLOCS);
+
+    arena.freeAll();
+
+    return sum != 0;
+}
@@ -0,0 +1,76 @@
+/* String hash benchmark: FNV-1a vs wyhash over JSON-like length distributions.
+ * Keys are short (mostly 3-24 bytes), string values spread wider, long strings are 64-512 bytes. */
+
+#include "hash.hh"
+#include "utils.hh"
+#include "logs.hh"
+#include "Array.hh"
+#include "DefaultAllocator.hh"
+
+struct Dist
+{
+    const char* sName;
+    u32 aLens[8]; /* picked uniformly */
+};
+
+static u64 s_rng = 0x9E3779B97F4A7C15;
+
+static u32
+rng()
+{
+    s_rng = s_rng * 6364136223846793005ULL + 1442695040888963407ULL;
+    return u32(s_rng >> 33);
+}
+
+int
+main()
+{
+    constexpr u32 N_STRINGS = 1 << 16;
+    constexpr u32 N_ROUNDS = 64;
+
+    const Dist aDists[] {
+        {"keys", {3, 4, 5, 7, 8, 10, 14, 24}},
+        {"values", {1, 6, 12, 17, 25, 33, 48, 90}},
+        {"long", {64, 96, 128, 160, 200, 256, 384, 512}},
+    };
+
+    u64 sum = 0;
+
+    COUT("%8s %10s %10s %10s %10s %10s\n", "dist", "avg len", "fnv ns", "wy ns", "fnv GB/s", "wy GB/s");
+
+    for (auto& d : aDists)
+    {
+        adt::Array<char> aData(&adt::StdAllocator);
+        adt::Array<u32> aOffs(&adt::StdAllocator, N_STRINGS + 1);
+
+        for (u32 i = 0; i < N_STRINGS; i++)
+        {
+            aOffs.push(aData._size);
+            u32 len = d.aLens[rng() & 7];
+            for (u32 j = 0; j < len; j++) aData.push(char('a' + rng() % 26));
+        }
+        aOffs.push(aData._size);
+
+        f64 t0 = adt::timeNowMS();
+        for (u32 r = 0; r < N_ROUNDS; r++)
+            for (u32 i = 0; i < N_STRINGS; i++)
+                sum += adt::hashFNV(&aData[aOffs[i]], aOffs[i + 1] - aOffs[i]);
+        f64 t1 = adt::timeNowMS();
+        for (u32 r = 0; r < N_ROUNDS; r++)
+            for (u32 i = 0; i < N_STRINGS; i++)
+                sum += adt::hashWY(&aData[aOffs[i]], aOffs[i + 1] - aOffs[i]);
+        f64 t2 = adt::timeNowMS();
+
+        f64 nHashes = f64(N_STRINGS) * N_ROUNDS;
+        f64 nBytes = f64(aData._size) * N_ROUNDS;
+        COUT("%8s %10.1f %10.2f %10.2f %10.2f %10.2f\n",
+            d.sName, f64(aData._size) / N_STRINGS,
+            (t1 - t0) * 1000000.0 / nHashes, (t2 - t1) * 1000000.0 / nHashes,
+            nBytes / ((t1 - t0) * 1000000.0), nBytes / ((t2 - t1) * 1000000.0));
+
+        aData.destroy();
+        aOffs.destroy();
+    }
+
+    return sum != 0;
+}
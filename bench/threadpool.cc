@@ -0,0 +1,77 @@
+/* ThreadPool throughput for tasks from 1 us to 1 ms, submitted from the main thread (injection queue)
+ * and fanned out from inside a task (worker deques, stealing). Efficiency is ideal time over measured. */
+
+#include "ThreadPool.hh"
+#include "DefaultAllocator.hh"
+#include "logs.hh"
+
+struct FanOut
+{
+    adt::ThreadPool* pPool;
+    u32 nTasks;
+};
+
+static f64 s_taskMS;
+static std::atomic<u64> s_nDone;
+
+static int
+spin(void*)
+{
+    f64 end = adt::timeNowMS() + s_taskMS;
+    while (adt::timeNowMS() < end)
+        ;
+    s_nDone.fetch_add(1, std::memory_order_relaxed);
+
+    return 0;
+}
+
+static int
+fanOut(void* pArgs)
+{
+    auto* f = (FanOut*)pArgs;
+    for (u32 i = 0; i < f->nTasks; i++)
+        f->pPool->submit(spin, nullptr);
+
+    return 0;
+}
+
+int
+main()
+{
+    constexpr f64 WORK_MS = 400.0; /* total task time per run */
+    const f64 aTaskUS[] {1, 10, 100, 1000};
+
+    adt::ThreadPool tp(&adt::StdAllocator);
+    tp.start();
+
+    COUT("threads: %u\n", tp._threadCount);
+    COUT("%10s %10s %14s %10s %14s %10s\n", "task us", "tasks", "main tasks/s", "eff", "fanout tasks/s", "eff");
+
+    for (f64 us : aTaskUS)
+    {
+        s_taskMS = us / 1000.0;
+        u32 nTasks = u32(WORK_MS / s_taskMS);
+        f64 ideal = WORK_MS / tp._threadCount;
+
+        s_nDone = 0;
+        f64 t0 = adt::timeNowMS();
+        for (u32 i = 0; i < nTasks; i++)
+            tp.submit(spin, nullptr);
+        tp.wait();
+        f64 t1 = adt::timeNowMS();
+
+        FanOut f {&tp, nTasks};
+        tp.submit(fanOut, &f);
+        tp.wait();
+        f64 t2 = adt::timeNowMS();
+
+        if (s_nDone != u64(nTasks) * 2)
+            CERR("lost tasks: %lu/%u\n", s_nDone.load(), nTasks * 2);
+
+        COUT("%10.0f %10u %14.0f %9.1f%% %14.0f %9.1f%%\n", us, nTasks,
+            nTasks / ((t1 - t0) / 1000.0), 100.0 * ideal / (t1 - t0),
+            nTasks / ((t2 - t1) / 1000.0), 100.0 * ideal / (t2 - t1));
+    }
+
+    tp.destroy();
+}
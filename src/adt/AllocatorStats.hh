@@ -0,0 +1,97 @@
+#pragma once
+
+/* Optional allocator instrumentation, compiled in with ADT_ALLOCATOR_STATS
+ * (cmake -DJSONASTCPP_ALLOCATOR_STATS=ON). Without it `ADT_STATS()` expands to nothing and allocators carry no
+ * extra state. */
+
+#ifdef ADT_ALLOCATOR_STATS
+    #define ADT_STATS(...) __VA_ARGS__
+#else
+    #define ADT_STATS(...)
+#endif
+
+#ifdef ADT_ALLOCATOR_STATS
+
+#include <stdio.h>
+
+#include "ultratypes.h"
+
+namespace adt
+{
+
+constexpr u32 ALLOCATOR_STATS_HISTOGRAM_SIZE = 65; /* bucket i: sizes in [2^(i-1), 2^i), bucket 0: zero */
+
+struct AllocatorStats
+{
+    u64 nAllocs; /* includes buffers moved by `realloc()` */
+    u64 nReallocs;
+    u64 nReallocsInPlace;
+    u64 nFrees;
+    u64 bytesRequested; /* sum of sizes asked for by `alloc()` and `realloc()` */
+    u64 bytesReserved; /* currently held from the system, headers included */
+    u64 nBlocks; /* arena blocks or live mallocs */
+    u64 bytesUsed; /* currently handed out, headers and alignment included */
+    u64 bytesUsedPeak;
+    u64 bytesWasted; /* in total: buffers left behind by `realloc()` and abandoned block tails */
+    u64 aHistogram[ALLOCATOR_STATS_HISTOGRAM_SIZE]; /* of requested sizes */
+
+    void
+    onAlloc(u64 requested, u64 used)
+    {
+        nAllocs++;
+        bytesRequested += requested;
+        aHistogram[requested ? 64 - __builtin_clzll(requested) : 0]++;
+        onUse(used);
+    }
+
+    void
+    onUse(u64 used)
+    {
+        bytesUsed += used;
+        if (bytesUsed > bytesUsedPeak) bytesUsedPeak = bytesUsed;
+    }
+
+    void
+    onReallocInPlace(u64 requested)
+    {
+        nReallocs++;
+        nReallocsInPlace++;
+        bytesRequested += requested;
+    }
+
+    void print(FILE* pf, const char* ntsName) const;
+};
+
+inline void
+AllocatorStats::print(FILE* pf, const char* ntsName) const
+{
+    auto human = [](u64 n, char* pBuff) -> const char* {
+        const char* aUnits[] {"B", "K", "M", "G", "T"};
+        double d = double(n);
+        int u = 0;
+        while (d >= 1024.0 && u < 4) { d /= 1024.0; u++; }
+        snprintf(pBuff, 32, u ? "%.1f%s" : "%.0f%s", d, aUnits[u]);
+        return pBuff;
+    };
+
+    char a0[32], a1[32], a2[32], a3[32], a4[32];
+    fprintf(pf, "%s:\n", ntsName);
+    fprintf(pf, "    allocs: %lu, frees: %lu, reallocs: %lu (in place: %.1f%%)\n",
+            nAllocs, nFrees, nReallocs, nReallocs ? 100.0 * nReallocsInPlace / nReallocs : 0.0);
+    fprintf(pf, "    requested: %s, reserved: %s in %lu blocks, used: %s (peak: %s), wasted: %s\n",
+            human(bytesRequested, a0), human(bytesReserved, a1), nBlocks, human(bytesUsed, a2),
+            human(bytesUsedPeak, a3), human(bytesWasted, a4));
+    fprintf(pf, "    size histogram:\n");
+
+    for (u32 i = 0; i < ALLOCATOR_STATS_HISTOGRAM_SIZE; i++)
+    {
+        if (!aHistogram[i]) continue;
+
+        if (i == 0) fprintf(pf, "        %10s: %lu\n", "0", aHistogram[i]);
+        else fprintf(pf, "        %10s: %lu\n", human(u64(1) << (i - 1), a0), aHistogram[i]);
+    }
+}
+
+} /* namespace adt */
+
+#endif
@@ -1,51 +1,84 @@
 #pragma once
 
-#include <math.h>
 #include <string.h>
 #include <stddef.h>
 
 #include "Allocator.hh"
+#include "AllocatorStats.hh"
 #include "ultratypes.h"
 
-#ifdef DEBUG
-    #include "logs.hh"
+#ifdef __linux__
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
 #endif
 
 #define ALIGN_TO_8_BYTES(x) (((x) + 8 - 1) & (~(8 - 1)))
 
 #define ARENA_FIRST(A) ((A)->_pBlocksHead)
 #define ARENA_NEXT(AB) ((AB)->pNext)
-#define ARENA_FOREACH(A, IT) for (ArenaBlock* IT = ARENA_FIRST(A); IT; IT = ARENA_NEXT(IT))
-#define ARENA_FOREACH_SAFE(A, IT, TMP) for (ArenaBlock* IT = ARENA_FIRST(A), * TMP = nullptr; IT && ((TMP) = ARENA_NEXT(IT), true); (IT) = (TMP))
+#define ARENA_FOREACH(A, IT) for (adt::ArenaBlock* IT = ARENA_FIRST(A); IT; IT = ARENA_NEXT(IT))
+#define ARENA_FOREACH_SAFE(A, IT, TMP) for (adt::ArenaBlock* IT = ARENA_FIRST(A), * TMP = nullptr; IT && ((TMP) = ARENA_NEXT(IT), true); (IT) = (TMP))
 
 namespace adt
 {
 
-struct ArenaNode;
+constexpr size_t ARENA_DEFAULT_BLOCK_SIZE = SIZE_1M;
+constexpr size_t ARENA_HUGE_PAGE_SIZE = 2 * SIZE_1M;
+
+/* how blocks are backed, linux only, everything falls back to calloc() */
+enum ARENA : u32
+{
+    ARENA_DEFAULT = 0,
+    ARENA_HUGE_PAGES = 1, /* 2M aligned mmap with MADV_HUGEPAGE (transparent huge pages) */
+    ARENA_HUGETLB = 1 << 1, /* explicit 2M pages with MAP_HUGETLB, then as ARENA_HUGE_PAGES if none are reserved */
+    ARENA_NUMA_LOCAL = 1 << 2, /* mmap and bind pages to the NUMA node of the thread that creates the block */
+};
 
 struct ArenaBlock
 {
     ArenaBlock* pNext = nullptr;
-    size_t size = 0;
-    ArenaNode* pLast = nullptr;
+    size_t size = 0; /* of `pData` */
+    size_t pos = 0; /* bump offset */
+    size_t dirty = 0; /* high water mark, `pData` past it is still zero from calloc */
+    size_t mapSize = 0; /* whole mapping if mmap'd, 0 if calloc'd */
     u8 pData[]; /* flexible array member */
 };
 
 struct ArenaNode
 {
-    ArenaNode* pNext = nullptr;
+    size_t size = 0; /* requested, what `realloc()` copies */
     u8 pData[];
 };
 
+/* position in the arena to roll back to */
+struct ArenaMark
+{
+    ArenaBlock* pBlock;
+    size_t pos;
+};
+
+/* Bump allocator over a list of blocks.
+ * `alloc()` bumps the current block, moving on to the next one (or appending a new one) when it doesn't fit.
+ * The most recent allocation can grow in place with `realloc()` and be given back with `free()`,
+ * everything else lives until `reset()` or `freeAll()`. Memory is zeroed like calloc(), reused memory is only
+ * cleared up to each block's high water mark. */
 struct ArenaAllocator : Allocator
 {
     ArenaBlock* _pBlocksHead = nullptr;
-    ArenaBlock* _pLastBlockAllocation = nullptr;
+    ArenaBlock* _pBlocksTail = nullptr;
+    ArenaBlock* _pCurrBlock = nullptr;
+    ArenaNode* _pLastAlloc = nullptr; /* in `_pCurrBlock` */
+    size_t _blockSize = ARENA_DEFAULT_BLOCK_SIZE;
+    u32 _eFlags = ARENA_DEFAULT;
+    ADT_STATS(AllocatorStats _stats {};)
 
     ArenaAllocator() = default;
-    ArenaAllocator(u32 cap);
+    ArenaAllocator(u32 cap, u32 eFlags = ARENA_DEFAULT);
 
-    void reset();
+    void reset(); /* keeps the blocks, allocation starts over from the first one */
+    ArenaMark mark(); /* allocations made before it can't grow in place or be freed anymore, see `ArenaScope` */
+    void rollback(ArenaMark m); /* drops everything allocated after `m`, the blocks stay for reuse */
     virtual void* alloc(size_t memberCount, size_t size) override final;
     virtual void free(void* p) override final;
     virtual void* realloc(void* p, size_t size) override final;
@@ -53,150 +86,261 @@ struct ArenaAllocator : Allocator
 
 private:
     ArenaBlock* newBlock(size_t size);
-    ArenaBlock* getFreeBlock();
+    ArenaBlock* mapBlock(size_t size);
+    ArenaBlock* nextBlock(size_t aligned);
 
     static ArenaNode* getNodeFromData(void* p) { return (ArenaNode*)((u8*)(p) - offsetof(ArenaNode, pData)); }
-    static ArenaNode* getNodeFromBlock(void* p) { return (ArenaNode*)((u8*)(p) + offsetof(ArenaBlock, pData)); }
 };
 
 inline 
-ArenaAllocator::ArenaAllocator(u32 cap)
+ArenaAllocator::ArenaAllocator(u32 cap, u32 eFlags)
+    : _blockSize(ALIGN_TO_8_BYTES(cap + sizeof(ArenaNode))), _eFlags(eFlags)
 {
-    newBlock(ALIGN_TO_8_BYTES(cap + sizeof(ArenaNode)));
+    _pCurrBlock = newBlock(_blockSize);
 }
 
 inline void
 ArenaAllocator::reset()
 {
     ARENA_FOREACH(this, pB)
+        pB->pos = 0;
+
+    _pCurrBlock = _pBlocksHead;
+    _pLastAlloc = nullptr;
+    ADT_STATS(_stats.bytesUsed = 0;)
+}
+
+/* `_pLastAlloc` is dropped, growing it in place would cross the mark and `rollback()` would hand its tail out again */
+inline ArenaMark
+ArenaAllocator::mark()
+{
+    _pLastAlloc = nullptr;
+    return {_pCurrBlock, _pCurrBlock ? _pCurrBlock->pos : 0};
+}
+
+inline void
+ArenaAllocator::rollback(ArenaMark m)
+{
+    if (!m.pBlock)
+    {
+        reset();
+        return;
+    }
+
+    /* blocks are only ever entered in list order, so the ones used since `m` follow it up to the current one */
+    for (ArenaBlock* pB = m.pBlock->pNext; pB && pB != _pCurrBlock->pNext; pB = pB->pNext)
     {
-        ArenaNode* pNode = getNodeFromBlock(pB);
-        pB->pLast = pNode;
-        pNode->pNext = pNode;
+        ADT_STATS(_stats.bytesUsed -= pB->pos;)
+        pB->pos = 0;
     }
 
-    auto first = ARENA_FIRST(this);
-    _pLastBlockAllocation = first;
+    ADT_STATS(_stats.bytesUsed -= m.pBlock->pos - m.pos;)
+    m.pBlock->pos = m.pos;
+    _pCurrBlock = m.pBlock;
+    _pLastAlloc = nullptr;
 }
 
+/* Fresh anonymous pages are zero already, so mapped blocks are never cleared.
+ * Returns nullptr when nothing works out and the caller falls back to calloc(). */
 inline ArenaBlock*
-ArenaAllocator::newBlock(size_t size)
+ArenaAllocator::mapBlock([[maybe_unused]] size_t size)
 {
-    ArenaBlock** ppLastBlock = &_pBlocksHead;
-    while (*ppLastBlock) ppLastBlock = &((*ppLastBlock)->pNext);
+#ifdef __linux__
+    size_t mapSize = (size + sizeof(ArenaBlock) + ARENA_HUGE_PAGE_SIZE - 1) & ~(ARENA_HUGE_PAGE_SIZE - 1);
+    u8* pMap = (u8*)MAP_FAILED;
 
-    size_t addedSize = size + sizeof(ArenaBlock);
+    if (_eFlags & ARENA_HUGETLB)
+        pMap = (u8*)mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
 
-    *ppLastBlock = (ArenaBlock*)(calloc(1, addedSize));
+    if (pMap == MAP_FAILED)
+    {
+        /* over-map and trim to get 2M alignment, unaligned ends can't be huge pages */
+        u8* pRaw = (u8*)mmap(nullptr, mapSize + ARENA_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pRaw == MAP_FAILED) return nullptr;
+
+        pMap = (u8*)(((size_t)pRaw + ARENA_HUGE_PAGE_SIZE - 1) & ~(ARENA_HUGE_PAGE_SIZE - 1));
+        if (pMap > pRaw) munmap(pRaw, pMap - pRaw);
+        size_t tail = (pRaw + mapSize + ARENA_HUGE_PAGE_SIZE) - (pMap + mapSize);
+        if (tail > 0) munmap(pMap + mapSize, tail);
+
+    #ifdef MADV_HUGEPAGE
+        if (_eFlags & (ARENA_HUGE_PAGES | ARENA_HUGETLB))
+            madvise(pMap, mapSize, MADV_HUGEPAGE);
+    #endif
+    }
 
-    auto* pBlock = (ArenaBlock*)*ppLastBlock;
-    pBlock->size = size;
-    auto* pNode = getNodeFromBlock(*ppLastBlock);
-    pNode->pNext = pNode; /* don't bump the very first node on `alloc()` */
-    pBlock->pLast = pNode;
-    _pLastBlockAllocation = *ppLastBlock;
+    if (_eFlags & ARENA_NUMA_LOCAL)
+    {
+        /* before the first touch, no libnuma */
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 && node < sizeof(unsigned long) * 8 * 16)
+        {
+            unsigned long aMask[16] {};
+            aMask[node / (sizeof(unsigned long) * 8)] = 1UL << (node % (sizeof(unsigned long) * 8));
+            constexpr int MPOL_PREFERRED_ = 1;
+            syscall(SYS_mbind, pMap, mapSize, MPOL_PREFERRED_, aMask, sizeof(aMask) * 8, 0);
+        }
+    }
 
-    return *ppLastBlock;
+    auto* pBlock = (ArenaBlock*)pMap;
+    pBlock->mapSize = mapSize;
+    pBlock->size = mapSize - sizeof(ArenaBlock);
+
+    return pBlock;
+#else
+    return nullptr;
+#endif
 }
 
+/* appended to the tail, doesn't become current */
 inline ArenaBlock*
-ArenaAllocator::getFreeBlock()
+ArenaAllocator::newBlock(size_t size)
 {
-    ArenaBlock* pCurrBlock = _pBlocksHead, * pFreeBlock = _pBlocksHead;
-    while (pCurrBlock)
+    ArenaBlock* pBlock = nullptr;
+
+    if (_eFlags != ARENA_DEFAULT)
+        pBlock = mapBlock(size);
+
+    if (!pBlock)
     {
-        pFreeBlock = pCurrBlock;
-        pCurrBlock = pCurrBlock->pNext;
+        pBlock = (ArenaBlock*)(::calloc(1, size + sizeof(ArenaBlock)));
+        pBlock->size = size;
     }
 
-    return pFreeBlock;
+    if (_pBlocksTail) _pBlocksTail->pNext = pBlock;
+    else _pBlocksHead = pBlock;
+    _pBlocksTail = pBlock;
+
+    ADT_STATS(
+        _stats.nBlocks++;
+        _stats.bytesReserved += pBlock->mapSize ? pBlock->mapSize : size + sizeof(ArenaBlock);
+    )
+
+    return pBlock;
 }
 
-inline void*
-ArenaAllocator::alloc(size_t memberCount, size_t memberSize)
+/* Slow path of `alloc()`: the rest of the current block is abandoned. Blocks past the current one exist only
+ * after `reset()`, those that are too small for this allocation are skipped for the rest of the cycle. */
+inline ArenaBlock*
+ArenaAllocator::nextBlock(size_t aligned)
 {
-    u32 requested = memberCount * memberSize;
-    size_t aligned = ALIGN_TO_8_BYTES(requested + sizeof(ArenaNode));
+    ArenaBlock* pB = _pCurrBlock ? _pCurrBlock->pNext : _pBlocksHead;
+    ADT_STATS(if (_pCurrBlock) _stats.bytesWasted += _pCurrBlock->size - _pCurrBlock->pos;)
 
-    /* TODO: find block that can fit */
-    ArenaBlock* pFreeBlock = _pBlocksHead;
+    while (pB && pB->pos + aligned > pB->size)
+        pB = pB->pNext;
 
-    while (aligned >= pFreeBlock->size)
-    {
-#ifdef DEBUG
-        LOG_WARN("requested size > than one block\n"
-                 "aligned: %zu, blockSize: %zu, requested: %u\n", aligned, pFreeBlock->size, requested);
-#endif
+    if (!pB) pB = newBlock(aligned > _blockSize ? aligned : _blockSize);
 
-        pFreeBlock = pFreeBlock->pNext;
-        if (!pFreeBlock) pFreeBlock = newBlock(aligned * 2); /* NOTE: trying to double too big of an array situation */
-    }
+    _pCurrBlock = pB;
+    return pB;
+}
 
-repeat:
-    /* skip pNext */
-    ArenaNode* pNode = getNodeFromBlock(pFreeBlock);
-    ArenaNode* pNextNode = pFreeBlock->pLast->pNext;
-    size_t nextAligned = ((u8*)pNextNode + aligned) - (u8*)pNode;
+inline void*
+ArenaAllocator::alloc(size_t memberCount, size_t memberSize)
+{
+    size_t requested = memberCount * memberSize;
+    size_t aligned = ALIGN_TO_8_BYTES(requested + sizeof(ArenaNode));
 
-    /* heap overflow */
-    if (nextAligned >= pFreeBlock->size)
-    {
-#ifdef DEBUG
-        LOG_WARN("block overflow\n");
-#endif
+    ArenaBlock* pB = _pCurrBlock;
+    if (!pB || pB->pos + aligned > pB->size)
+        pB = nextBlock(aligned);
 
-        pFreeBlock = pFreeBlock->pNext;
-        if (!pFreeBlock) pFreeBlock = newBlock(nextAligned);
-        goto repeat;
-    }
+    auto* pNode = (ArenaNode*)&pB->pData[pB->pos];
+    if (pB->pos < pB->dirty)
+        memset(pNode, 0, pB->dirty - pB->pos < aligned ? pB->dirty - pB->pos : aligned);
 
-    pNextNode->pNext = (ArenaNode*)((u8*)pNextNode + aligned);
-    pFreeBlock->pLast = pNextNode;
+    pB->pos += aligned;
+    if (pB->pos > pB->dirty) pB->dirty = pB->pos;
 
-    return &pNextNode->pData;
+    pNode->size = requested;
+    _pLastAlloc = pNode;
+    ADT_STATS(_stats.onAlloc(requested, aligned);)
+
+    return pNode->pData;
 }
 
 inline void
-ArenaAllocator::free([[maybe_unused]] void* p)
+ArenaAllocator::free(void* p)
 {
-    /* no individual frees */
+    /* only the most recent allocation can be given back */
+    if (p && getNodeFromData(p) == _pLastAlloc)
+    {
+        size_t pos = (u8*)_pLastAlloc - _pCurrBlock->pData;
+        ADT_STATS(_stats.nFrees++; _stats.bytesUsed -= _pCurrBlock->pos - pos;)
+        _pCurrBlock->pos = pos;
+        _pLastAlloc = nullptr;
+    }
 }
 
 inline void*
 ArenaAllocator::realloc(void* p, size_t size)
 {
-    ArenaNode* pNode = getNodeFromData(p);
-    ArenaBlock* pBlock = nullptr;
-
-    /* figure out which block this node belongs to */
-    ARENA_FOREACH(this, pB)
-        if ((u8*)p > (u8*)pB && ((u8*)pB + pB->size) > (u8*)p)
-            pBlock = pB;
+    if (!p) return alloc(1, size);
 
-    auto aligned = ALIGN_TO_8_BYTES(size);
-    size_t nextAligned = ((u8*)pNode + aligned) - (u8*)getNodeFromBlock(pBlock);
+    ArenaNode* pNode = getNodeFromData(p);
 
-    if (pNode == pBlock->pLast && nextAligned < pBlock->size)
+    if (pNode == _pLastAlloc)
     {
-        /* NOTE: + sizeof(ArenaNode) is necessary */
-        pNode->pNext = (ArenaNode*)((u8*)pNode + aligned + sizeof(ArenaNode));
-
-        return p;
+        ArenaBlock* pB = _pCurrBlock;
+        size_t end = ((u8*)pNode - pB->pData) + ALIGN_TO_8_BYTES(size + sizeof(ArenaNode));
+
+        if (end <= pB->size)
+        {
+            ADT_STATS(_stats.onReallocInPlace(size); _stats.onUse(end - pB->pos);)
+            pB->pos = end;
+            if (end > pB->dirty) pB->dirty = end;
+            pNode->size = size;
+
+            return p;
+        }
     }
-    else
+    else if (size <= pNode->size)
     {
-        void* pR = alloc(1, size);
-        memcpy(pR, p, ((u8*)pNode->pNext - (u8*)pNode));
-
-        return pR;
+        ADT_STATS(_stats.onReallocInPlace(size);)
+        return p;
     }
+
+    ADT_STATS(_stats.nReallocs++; _stats.bytesWasted += ALIGN_TO_8_BYTES(pNode->size + sizeof(ArenaNode));)
+    void* pR = alloc(1, size);
+    memcpy(pR, p, pNode->size < size ? pNode->size : size);
+
+    return pR;
 }
 
 inline void
 ArenaAllocator::freeAll()
 {
     ARENA_FOREACH_SAFE(this, pB, tmp)
+    {
+#ifdef __linux__
+        if (pB->mapSize)
+        {
+            munmap(pB, pB->mapSize);
+            continue;
+        }
+#endif
         ::free(pB);
+    }
+
+    _pBlocksHead = _pBlocksTail = _pCurrBlock = nullptr;
+    _pLastAlloc = nullptr;
+    ADT_STATS(_stats.bytesReserved = _stats.nBlocks = _stats.bytesUsed = 0;)
 }
 
+/* Rolls `pArena` back to where it was on construction, for scratch work on top of data that has to survive.
+ * Memory from before the scope is never handed out again, but growing it inside the scope moves it into
+ * scoped memory, so grow what has to outlive the scope before entering it. */
+struct ArenaScope
+{
+    ArenaAllocator* _pArena;
+    ArenaMark _mark;
+
+    ArenaScope(ArenaAllocator* p) : _pArena(p), _mark(p->mark()) {}
+    ~ArenaScope() { _pArena->rollback(_mark); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
 } /* namespace adt */
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <new>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+
 #include "Allocator.hh"
 #include "ultratypes.h"
 
@@ -22,6 +27,9 @@ struct Array
     const T& operator[](u32 i) const { return _pData[i]; }
 
     T* push(const T& data);
+    template<typename... ARGS> T* emplace(ARGS&&... args); /* constructed in place */
+    T* append(const T* pData, u32 size); /* returns the first appended element */
+    T* append(const Array<T>& a) { return append(a._pData, a._size); }
     T* pop();
     T& back() { return _pData[_size - 1]; }
     const T& back() const { return back(); }
@@ -31,7 +39,9 @@ struct Array
     const T* data() const { return data(); }
     bool empty() const { return _size == 0;  }
     void resize(u32 _size);
-    void grow(u32 _size);
+    void reserve(u32 size) { if (size > _capacity) grow(size); }
+    void shrinkToFit();
+    void grow(u32 _size); /* sets capacity: realloc for trivially copyable types, move to a new buffer otherwise */
     void destroy() { _pAlloc->free(_pData); }
 
     struct It
@@ -64,14 +74,55 @@ template<typename T>
 inline T*
 Array<T>::push(const T& data)
 {
-    assert(_capacity > 0 && "pushing to the uninitialized array");
+    assert(_pAlloc && "pushing to the uninitialized array");
 
     if (_size >= _capacity)
-        grow(_capacity * 2);
+        grow(_capacity ? _capacity * 2 : SIZE_MIN);
 
-    _pData[_size++] = data;
+    return new(&_pData[_size++]) T(data);
+}
 
-    return &back();
+template<typename T>
+template<typename... ARGS>
+inline T*
+Array<T>::emplace(ARGS&&... args)
+{
+    assert(_pAlloc && "pushing to the uninitialized array");
+
+    if (_size >= _capacity)
+        grow(_capacity ? _capacity * 2 : SIZE_MIN);
+
+    return new(&_pData[_size++]) T(std::forward<ARGS>(args)...);
+}
+
+template<typename T>
+inline T*
+Array<T>::append(const T* pData, u32 size)
+{
+    assert(_pAlloc && "appending to the uninitialized array");
+
+    if (_size + size > _capacity)
+    {
+        u32 cap = _capacity ? _capacity * 2 : SIZE_MIN;
+        while (cap < _size + size) cap *= 2;
+        grow(cap);
+    }
+
+    T* pFirst = &_pData[_size];
+
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        if (size > 0) memcpy(pFirst, pData, sizeof(T) * size);
+    }
+    else
+    {
+        for (u32 i = 0; i < size; i++)
+            new(&pFirst[i]) T(pData[i]);
+    }
+
+    _size += size;
+
+    return pFirst;
 }
 
 template<typename T>
@@ -86,9 +137,7 @@ template<typename T>
 inline void
 Array<T>::resize(u32 size)
 {
-    if (_size < size)
-        grow(size);
-
+    reserve(size);
     _size = size;
 }
 
@@ -96,8 +145,44 @@ template<typename T>
 inline void
 Array<T>::grow(u32 size)
 {
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        _pData = (T*)(_pAlloc->realloc(_pData, sizeof(T) * size));
+    }
+    else
+    {
+        T* pNew = (T*)(_pAlloc->alloc(size, sizeof(T)));
+        u32 n = _size < size ? _size : size;
+
+        for (u32 i = 0; i < n; i++)
+        {
+            new(&pNew[i]) T(std::move(_pData[i]));
+            _pData[i].~T();
+        }
+
+        _pAlloc->free(_pData);
+        _pData = pNew;
+    }
+
     _capacity = size;
-    _pData = (T*)(_pAlloc->realloc(_pData, sizeof(T) * size));
+}
+
+template<typename T>
+inline void
+Array<T>::shrinkToFit()
+{
+    if (_size == _capacity)
+        return;
+
+    if (_size == 0)
+    {
+        _pAlloc->free(_pData);
+        _pData = nullptr;
+        _capacity = 0;
+        return;
+    }
+
+    grow(_size);
 }
 
 } /* namespace adt */
@@ -4,19 +4,30 @@
 
 #include "Array.hh"
 #include "DefaultAllocator.hh"
+#include "AllocatorStats.hh"
+#include "utils.hh"
 
 namespace adt
 {
 
 struct ArrayAllocatorNode
 {
-    u64 selfIdx; /* 8 byte alignment for allocators */
-    u8 pData[];
+    u64 size; /* requested */
+    u32 selfIdx; /* in `_aCleanList` */
+    u16 offset; /* from the malloc'd pointer to this node */
+    u8 alignLog2; /* non zero for `allocAligned()` blocks over 16 bytes, `realloc()` keeps it */
+    u8 _pad;
+    u8 pData[]; /* 16 byte aligned unless asked for more */
 };
 
+/* Every allocation is malloc'd and tracked in `_aCleanList` so `freeAll()` can release what's left.
+ * Freed entries form an intrusive free list through the clean list itself (odd values hold the next free index),
+ * so a long lived allocator reuses slots instead of growing, and `realloc()` keeps its slot. */
 struct ArrayAllocator : Allocator
 {
     Array<void*> _aCleanList;
+    u32 _freeHead = NPOS; /* first free entry in `_aCleanList` */
+    ADT_STATS(AllocatorStats _stats {};)
 
     ArrayAllocator() : _aCleanList(&StdAllocator) {}
     ArrayAllocator(u32 prealloc) : _aCleanList(&StdAllocator, prealloc) {}
@@ -24,46 +35,149 @@ struct ArrayAllocator : Allocator
     virtual void* alloc(size_t memberCount, size_t memberSize) override final;
     virtual void free(void* p) override final;
     virtual void* realloc(void* p, size_t size) override final;
+    void* allocNoZero(size_t memberCount, size_t memberSize);
+    void* allocAligned(size_t size, size_t alignment); /* `alignment` is a power of two up to 32K, not zeroed */
     void freeAll();
 
 private:
     static ArrayAllocatorNode* ptrToNode(const void* p) { return (ArrayAllocatorNode*)((u8*)p - sizeof(ArrayAllocatorNode)); }
+    static void* nodeToBase(ArrayAllocatorNode* pNode) { return (u8*)pNode - pNode->offset; }
+    static bool isFree(void* e) { return (u64)e & 1; }
+
+    u32 track(void* pBase);
 };
 
+/* takes a free entry or appends one */
+inline u32
+ArrayAllocator::track(void* pBase)
+{
+    if (_freeHead != NPOS)
+    {
+        u32 idx = _freeHead;
+        _freeHead = u32((u64)_aCleanList[idx] >> 1);
+        _aCleanList[idx] = pBase;
+
+        return idx;
+    }
+
+    _aCleanList.push(pBase);
+    return _aCleanList._size - 1;
+}
+
 inline void*
-ArrayAllocator::alloc(size_t memberCount, size_t memberSize)
+ArrayAllocator::allocNoZero(size_t memberCount, size_t memberSize)
 {
-    void* r = ::malloc(memberCount*memberSize + sizeof(ArrayAllocatorNode));
-    memset(r, 0, memberCount*memberSize + sizeof(ArrayAllocatorNode));
+    size_t size = memberCount * memberSize;
+    auto* pNode = (ArrayAllocatorNode*)::malloc(size + sizeof(ArrayAllocatorNode));
+
+    pNode->size = size;
+    pNode->offset = 0;
+    pNode->alignLog2 = 0;
+    pNode->selfIdx = track(pNode); /* keep idx of this allocation in array to free later */
 
-    auto* pNode = (ArrayAllocatorNode*)r;
-    _aCleanList.push(pNode);
-    pNode->selfIdx = _aCleanList._size - 1; /* keep idx of this allocation in array to free later */
+    ADT_STATS(
+        _stats.onAlloc(size, size + sizeof(ArrayAllocatorNode));
+        _stats.nBlocks++;
+        _stats.bytesReserved += size + sizeof(ArrayAllocatorNode);
+    )
 
     return pNode->pData;
 }
 
+inline void*
+ArrayAllocator::alloc(size_t memberCount, size_t memberSize)
+{
+    void* p = allocNoZero(memberCount, memberSize);
+    memset(p, 0, memberCount * memberSize);
+
+    return p;
+}
+
+inline void*
+ArrayAllocator::allocAligned(size_t size, size_t alignment)
+{
+    assert((alignment & (alignment - 1)) == 0 && "alignment must be a power of two");
+    assert(alignment <= (1 << 15) && "offset is u16");
+    if (alignment < 16) alignment = 16;
+
+    u8* pBase = (u8*)::malloc(size + sizeof(ArrayAllocatorNode) + alignment);
+    u8* pData = (u8*)(((u64)pBase + sizeof(ArrayAllocatorNode) + alignment - 1) & ~(alignment - 1));
+
+    auto* pNode = ptrToNode(pData);
+    pNode->size = size;
+    pNode->offset = u16((u8*)pNode - pBase);
+    pNode->alignLog2 = alignment > 16 ? u8(__builtin_ctzll(alignment)) : 0; /* malloc gives 16 anyway */
+    pNode->selfIdx = track(pBase);
+
+    /* alignment padding is not counted, `free()` can't tell it */
+    ADT_STATS(
+        _stats.onAlloc(size, size + sizeof(ArrayAllocatorNode));
+        _stats.nBlocks++;
+        _stats.bytesReserved += size + sizeof(ArrayAllocatorNode);
+    )
+
+    return pData;
+}
+
 inline void
 ArrayAllocator::free(void* p)
 {
+    if (!p) return;
+
     auto* pNode = ptrToNode(p);
-    assert(_aCleanList[pNode->selfIdx] != nullptr && "double free");
-    _aCleanList[pNode->selfIdx] = nullptr;
-    ::free(pNode);
+    u32 idx = pNode->selfIdx;
+    assert(!isFree(_aCleanList[idx]) && "double free");
+
+    ADT_STATS(
+        _stats.nFrees++;
+        _stats.nBlocks--;
+        _stats.bytesUsed -= pNode->size + sizeof(ArrayAllocatorNode);
+        _stats.bytesReserved -= pNode->size + sizeof(ArrayAllocatorNode);
+    )
+
+    _aCleanList[idx] = (void*)(((u64)_freeHead << 1) | 1);
+    _freeHead = idx;
+    ::free(nodeToBase(pNode));
 }
 
 inline void*
 ArrayAllocator::realloc(void* p, size_t size)
 {
+    if (!p) return allocNoZero(1, size);
+
     auto* pNode = ptrToNode(p);
-    u64 idx = pNode->selfIdx;
+    u32 idx = pNode->selfIdx;
+
+    /* `::realloc()` would only keep 16 */
+    if (pNode->alignLog2 != 0)
+    {
+        ADT_STATS(_stats.nReallocs++;)
+        void* pNew = allocAligned(size, size_t(1) << pNode->alignLog2);
+        memcpy(pNew, p, pNode->size < size ? pNode->size : size);
+        free(p);
+
+        return pNew;
+    }
 
-    void* r = ::realloc(pNode, size + sizeof(ArrayAllocatorNode));
-    auto pNew = (ArrayAllocatorNode*)r;
+    ADT_STATS(u64 oldSize = pNode->size;)
+    auto* pNew = (ArrayAllocatorNode*)::realloc(pNode, size + sizeof(ArrayAllocatorNode)); /* offset is 0 here */
 
-    _aCleanList[idx] = nullptr;
-    _aCleanList.push(pNew);
-    pNew->selfIdx = _aCleanList._size - 1;
+    ADT_STATS(
+        if (pNew == pNode)
+        {
+            _stats.onReallocInPlace(size);
+        }
+        else
+        {
+            _stats.nReallocs++;
+            _stats.bytesRequested += size;
+        }
+        _stats.onUse(size - oldSize);
+        _stats.bytesReserved += size - oldSize;
+    )
+
+    pNew->size = size;
+    _aCleanList[idx] = pNew;
 
     return pNew->pData;
 }
@@ -72,13 +186,12 @@ inline void
 ArrayAllocator::freeAll()
 {
     for (void* e : _aCleanList)
-        if (e)
-        {
+        if (e && !isFree(e))
             ::free(e);
-            e = nullptr;
-        }
 
     _aCleanList.destroy();
+    _freeHead = NPOS;
+    ADT_STATS(_stats.bytesReserved = _stats.nBlocks = _stats.bytesUsed = 0;)
 }
 
 } /* namespace adt */
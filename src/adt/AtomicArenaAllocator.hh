@@ -51,6 +51,18 @@ struct AtomicArenaAllocator : Allocator
         mtx_unlock(&_mtxA);
     }
 
+    ADT_STATS(
+        AllocatorStats
+        getStats()
+        {
+            mtx_lock(&_mtxA);
+            auto r = _arena._stats;
+            mtx_unlock(&_mtxA);
+
+            return r;
+        }
+    )
+
     void
     freeAll()
     {
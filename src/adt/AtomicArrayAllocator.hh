@@ -18,7 +18,20 @@ struct AtomicArrayAllocator : Allocator
     virtual void* alloc(size_t memberCount, size_t memberSize) override final;
     virtual void free(void* p) override final;
     virtual void* realloc(void* p, size_t size) override final;
+    void* allocNoZero(size_t memberCount, size_t memberSize);
+    void* allocAligned(size_t size, size_t alignment);
     void freeAll();
+    ADT_STATS(
+        AllocatorStats
+        getStats()
+        {
+            mtx_lock(&_mtx);
+            auto r = _lAlloc._stats;
+            mtx_unlock(&_mtx);
+
+            return r;
+        }
+    )
 };
 
 inline void*
@@ -31,6 +44,26 @@ AtomicArrayAllocator::alloc(size_t memberCount, size_t memberSize)
     return r;
 }
 
+inline void*
+AtomicArrayAllocator::allocNoZero(size_t memberCount, size_t memberSize)
+{
+    mtx_lock(&_mtx);
+    void* r = _lAlloc.allocNoZero(memberCount, memberSize);
+    mtx_unlock(&_mtx);
+
+    return r;
+}
+
+inline void*
+AtomicArrayAllocator::allocAligned(size_t size, size_t alignment)
+{
+    mtx_lock(&_mtx);
+    void* r = _lAlloc.allocAligned(size, alignment);
+    mtx_unlock(&_mtx);
+
+    return r;
+}
+
 inline void
 AtomicArrayAllocator::free(void* p)
 {
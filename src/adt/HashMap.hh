@@ -1,144 +1,356 @@
 #pragma once
 
-#include "Array.hh"
+#include <new>
+#include <string.h>
+#include <utility>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#include "Allocator.hh"
 #include "hash.hh"
+#include "utils.hh"
 
 namespace adt
 {
 
-constexpr f64 HASHMAP_DEFAULT_LOAD_FACTOR = 0.5;
+constexpr u32 HASHMAP_GROUP_SIZE = 16;
+constexpr u32 HASHMAP_MIN_CAPACITY = HASHMAP_GROUP_SIZE;
+constexpr f64 HASHMAP_DEFAULT_LOAD_FACTOR = 0.875; /* 7/8, see `maxGrowth()` */
 
-template<typename T>
-struct Bucket
+/* control byte per slot: full slots hold the low 7 bits of the hash (H2), others have the sign bit set */
+enum HASHMAP_CTRL : u8
 {
-    T data;
-    bool bOccupied = false;
-    bool bDeleted = false;
+    HASHMAP_EMPTY = 0x80,
+    HASHMAP_DELETED = 0xFE,
 };
 
-template <typename T>
+/* bitmasks over one group of 16 control bytes, bit i is slot i of the group */
+struct HashMapGroup
+{
+#if defined(__SSE2__)
+    __m128i _ctrl;
+
+    HashMapGroup(const u8* p) : _ctrl(_mm_loadu_si128((const __m128i*)p)) {}
+
+    u32 match(u8 h2) const { return _mm_movemask_epi8(_mm_cmpeq_epi8(_ctrl, _mm_set1_epi8(h2))); }
+    u32 matchEmpty() const { return _mm_movemask_epi8(_mm_cmpeq_epi8(_ctrl, _mm_set1_epi8(char(HASHMAP_EMPTY)))); }
+    u32 matchEmptyOrDeleted() const { return _mm_movemask_epi8(_ctrl); }
+#else
+    const u8* _p;
+
+    HashMapGroup(const u8* p) : _p(p) {}
+
+    u32
+    matchByte(u8 b) const
+    {
+        u32 m = 0;
+        for (u32 i = 0; i < HASHMAP_GROUP_SIZE; i++)
+            if (_p[i] == b) m |= 1U << i;
+        return m;
+    }
+
+    u32 match(u8 h2) const { return matchByte(h2); }
+    u32 matchEmpty() const { return matchByte(HASHMAP_EMPTY); }
+
+    u32
+    matchEmptyOrDeleted() const
+    {
+        u32 m = 0;
+        for (u32 i = 0; i < HASHMAP_GROUP_SIZE; i++)
+            if (_p[i] & 0x80) m |= 1U << i;
+        return m;
+    }
+#endif
+};
+
+template<typename T>
 struct HashMapRet
 {
-    T* pData_;
-    size_t hash_;
-    u32 idx_;
-    bool bInserted_;
+    T* pData; /* nullptr if not found */
+    u64 hash;
+    u32 idx; /* slot, for `remove()` */
+    bool bInserted;
 };
 
-/* `adt::fnHash<T>()` for hash function, linear probing */
+/* whole value is the key */
 template<typename T>
-struct HashMap
+struct HashMapKeySelf
 {
-    Allocator* pAlloc_;
-    Array<Bucket<T>> aBuckets_;
-    f64 maxLoadFactor_;
-    u32 bucketCount_ = 0;
+    static const T& get(const T& v) { return v; }
+};
 
-    HashMap() = default;
-    HashMap(Allocator* pAllocator) : pAlloc_(pAllocator), aBuckets_(pAllocator, SIZE_MIN), maxLoadFactor_(HASHMAP_DEFAULT_LOAD_FACTOR) {}
-    HashMap(Allocator* pAllocator, u32 prealloc) : pAlloc_(pAllocator), aBuckets_(pAllocator, prealloc), maxLoadFactor_(HASHMAP_DEFAULT_LOAD_FACTOR) {}
+/* Swiss table: open addressing over groups of 16 slots with one control byte each.
+ * A lookup hashes once, compares the 7 bit H2 of the whole group in one SSE2 compare and only touches
+ * slots that match. Groups are probed quadratically from H1, the search stops at the first group that has an
+ * empty slot. Capacity is a power of two, the table grows at 7/8 load. Removing from a group that still has an
+ * empty slot frees the slot for good, otherwise it leaves a tombstone; when tombstones eat the growth budget
+ * the table is rebuilt at the same capacity instead of doubling. `adt::fnHash<K>()` for hash function. */
+template<typename T, typename K = T, typename KEY_OF = HashMapKeySelf<T>>
+struct HashTable
+{
+    Allocator* _pAlloc {};
+    u8* _pCtrl {};
+    T* _pSlots {};
+    u32 _capacity {};
+    u32 _size {};
+    u32 _growthLeft {}; /* inserts into empty slots until rehash */
 
-    Bucket<T>& operator[](u32 i) { return aBuckets_[i]; }
-    const Bucket<T>& operator[](u32 i) const { return aBuckets_[i]; }
+    HashTable() = default;
+    HashTable(Allocator* pAllocator) : HashTable(pAllocator, SIZE_MIN) {}
+    HashTable(Allocator* pAllocator, u32 prealloc);
 
-    f64 loadFactor() const { return static_cast<f64>(bucketCount_) / static_cast<f64>(aBuckets_.capacity_); }
-    u32 capacity() const { return aBuckets_.capacity_; }
-    HashMapRet<T> insert(const T& value);
-    HashMapRet<T> search(const T& value);
+    T& operator[](u32 i) { return _pSlots[i]; }
+    const T& operator[](u32 i) const { return _pSlots[i]; }
+
+    bool occupied(u32 i) const { return !(_pCtrl[i] & 0x80); }
+    f64 loadFactor() const { return f64(_size) / f64(_capacity); }
+    u32 capacity() const { return _capacity; }
+    u32 size() const { return _size; }
+    HashMapRet<T> insert(const T& value); /* doesn't look for an existing key, see `tryInsert()` */
+    HashMapRet<T> search(const K& key);
     void remove(u32 i);
-    void rehash(u32 _size);
-    HashMapRet<T> tryInsert(const T& value);
-    void destroy() { aBuckets_.destroy(); }
+    void rehash(u32 size); /* to at least `size` slots, same size drops tombstones */
+    HashMapRet<T> tryInsert(const T& value); /* existing entry or the inserted one */
+    void destroy();
+
+    struct It
+    {
+        HashTable* _s;
+        u32 _i;
+
+        It(HashTable* s, u32 i) : _s(s), _i(i) { skip(); }
+
+        T& operator*() const { return _s->_pSlots[_i]; }
+        T* operator->() const { return &_s->_pSlots[_i]; }
+        It operator++() { _i++; skip(); return *this; }
+        friend bool operator==(const It& l, const It& r) { return l._i == r._i; }
+        friend bool operator!=(const It& l, const It& r) { return l._i != r._i; }
+
+    private:
+        void skip() { while (_i < _s->_capacity && !_s->occupied(_i)) _i++; }
+    };
+
+    It begin() { return {this, 0}; }
+    It end() { return {this, _capacity}; }
+
+private:
+    u32 maxGrowth() const { return _capacity - _capacity / 8; }
+    u32 groupMask() const { return _capacity / HASHMAP_GROUP_SIZE - 1; }
+    void setCtrl(u32 i, u8 c) { _pCtrl[i] = c; }
+    void init(u32 capacity);
+    u32 findInsertSlot(u64 hash);
+    void rehashOrGrow();
+
+    /* hashes are mixed here, `fnHash` may be identity for integers */
+    static u64
+    hashOf(const K& key)
+    {
+        u64 h = fnHash(key);
+        h ^= h >> 32;
+        return h * 0x9E3779B97F4A7C15ULL;
+    }
+
+    static u8 h2Of(u64 hash) { return u8(hash >> 57); }
+    static u32 h1Of(u64 hash) { return u32(hash >> 7); } /* low bits of the product are the weakest */
 };
 
-template<typename T>
-inline HashMapRet<T>
-HashMap<T>::insert(const T& value)
+template<typename T, typename K, typename KEY_OF>
+inline
+HashTable<T, K, KEY_OF>::HashTable(Allocator* pAllocator, u32 prealloc)
+    : _pAlloc(pAllocator)
+{
+    u32 cap = HASHMAP_MIN_CAPACITY;
+    /* room for `prealloc` without growing */
+    while (cap - cap / 8 < prealloc) cap *= 2;
+
+    init(cap);
+}
+
+template<typename T, typename K, typename KEY_OF>
+inline void
+HashTable<T, K, KEY_OF>::init(u32 capacity)
 {
-    if (loadFactor() >= maxLoadFactor_)
-        rehash(capacity() * 2);
+    _capacity = capacity;
+    _size = 0;
+    _pCtrl = (u8*)_pAlloc->alloc(capacity, sizeof(u8));
+    _pSlots = (T*)_pAlloc->alloc(capacity, sizeof(T));
+    memset(_pCtrl, HASHMAP_EMPTY, capacity);
+    _growthLeft = maxGrowth();
+}
 
-    size_t hash = fnHash(value);
-    u32 idx = u32(hash % capacity());
+template<typename T, typename K, typename KEY_OF>
+inline u32
+HashTable<T, K, KEY_OF>::findInsertSlot(u64 hash)
+{
+    u32 mask = groupMask();
+    u32 g = h1Of(hash) & mask;
 
-    while (aBuckets_[idx].bOccupied)
+    for (u32 i = 0; ; g = (g + ++i) & mask)
     {
-        idx++;
-        if (idx >= capacity())
-            idx = 0;
+        u32 m = HashMapGroup(&_pCtrl[g * HASHMAP_GROUP_SIZE]).matchEmptyOrDeleted();
+        if (m) return g * HASHMAP_GROUP_SIZE + __builtin_ctz(m);
     }
+}
 
-    aBuckets_[idx].data = value;
-    aBuckets_[idx].bOccupied = true;
-    aBuckets_[idx].bDeleted = false;
-    bucketCount_++;
+template<typename T, typename K, typename KEY_OF>
+inline HashMapRet<T>
+HashTable<T, K, KEY_OF>::insert(const T& value)
+{
+    if (_growthLeft == 0)
+        rehashOrGrow();
+
+    u64 hash = hashOf(KEY_OF::get(value));
+    u32 idx = findInsertSlot(hash);
+
+    if (_pCtrl[idx] == HASHMAP_EMPTY) _growthLeft--;
+    setCtrl(idx, h2Of(hash));
+    new(&_pSlots[idx]) T(value);
+    _size++;
 
     return {
-        .pData = &aBuckets_[idx].data,
+        .pData = &_pSlots[idx],
         .hash = hash,
         .idx = idx,
         .bInserted = true
     };
 }
 
-template<typename T>
+template<typename T, typename K, typename KEY_OF>
 inline HashMapRet<T>
-HashMap<T>::search(const T& value)
+HashTable<T, K, KEY_OF>::search(const K& key)
 {
-    size_t hash = fnHash(value);
-    u32 idx = u32(hash % capacity());
-
-    HashMapRet<T> ret;
-    ret.hash_ = hash;
-    ret.pData_ = nullptr;
-    ret.bInserted_ = false;
+    u64 hash = hashOf(key);
+    u8 h2 = h2Of(hash);
+    u32 mask = groupMask();
+    u32 g = h1Of(hash) & mask;
 
-    while (aBuckets_[idx].bOccupied || aBuckets_[idx].bDeleted)
+    /* triangular probing visits every group once in `mask + 1` steps */
+    for (u32 i = 0; i <= mask; g = (g + ++i) & mask)
     {
-        if (aBuckets_[idx].data == value)
+        HashMapGroup grp(&_pCtrl[g * HASHMAP_GROUP_SIZE]);
+
+        for (u32 m = grp.match(h2); m; m &= m - 1)
         {
-            ret.pData_ = &aBuckets_[idx].data;
-            break;
+            u32 idx = g * HASHMAP_GROUP_SIZE + __builtin_ctz(m);
+            if (KEY_OF::get(_pSlots[idx]) == key)
+                return {.pData = &_pSlots[idx], .hash = hash, .idx = idx, .bInserted = false};
         }
 
-        idx++;
-        if (idx >= capacity())
-            idx = 0;
+        if (grp.matchEmpty())
+            break;
     }
 
-    ret.idx_ = idx;
-    return ret;
+    return {.pData = nullptr, .hash = hash, .idx = NPOS, .bInserted = false};
 }
 
-template<typename T>
+template<typename T, typename K, typename KEY_OF>
 inline void
-HashMap<T>::remove(u32 i)
+HashTable<T, K, KEY_OF>::remove(u32 i)
 {
-    aBuckets_[i].bDeleted = true;
-    aBuckets_[i].bOccupied = false;
+    assert(occupied(i) && "removing empty slot");
+
+    /* a probe that reaches this group stops here anyway, so nothing further depends on it being full */
+    u32 g = i & ~(HASHMAP_GROUP_SIZE - 1);
+    if (HashMapGroup(&_pCtrl[g]).matchEmpty())
+    {
+        setCtrl(i, HASHMAP_EMPTY);
+        _growthLeft++;
+    }
+    else
+    {
+        setCtrl(i, HASHMAP_DELETED);
+    }
+
+    _pSlots[i].~T();
+    _size--;
 }
 
-template<typename T>
+template<typename T, typename K, typename KEY_OF>
+inline void
+HashTable<T, K, KEY_OF>::rehashOrGrow()
+{
+    /* mostly tombstones: rebuild at the same size */
+    if (u64(_size) * 32 <= u64(_capacity) * 25)
+        rehash(_capacity);
+    else rehash(_capacity * 2);
+}
+
+template<typename T, typename K, typename KEY_OF>
 inline void
-HashMap<T>::rehash(u32 _size)
+HashTable<T, K, KEY_OF>::rehash(u32 size)
 {
-    auto mNew = HashMap<T>(aBuckets_.pAlloc, _size);
+    u32 cap = HASHMAP_MIN_CAPACITY;
+    while (cap < size || cap - cap / 8 < _size) cap *= 2;
 
-    for (u32 i = 0; i < aBuckets_.capacity_; i++)
-        if (aBuckets_[i].bOccupied)
-            mNew.insert(aBuckets_[i].data);
+    HashTable mNew;
+    mNew._pAlloc = _pAlloc;
+    mNew.init(cap);
+
+    for (u32 i = 0; i < _capacity; i++)
+    {
+        if (!occupied(i)) continue;
+
+        u64 hash = hashOf(KEY_OF::get(_pSlots[i]));
+        u32 idx = mNew.findInsertSlot(hash);
+        mNew.setCtrl(idx, h2Of(hash));
+        new(&mNew._pSlots[idx]) T(std::move(_pSlots[i]));
+        mNew._growthLeft--;
+        mNew._size++;
+    }
 
     destroy();
     *this = mNew;
 }
 
-template<typename T>
+template<typename T, typename K, typename KEY_OF>
 inline HashMapRet<T>
-HashMap<T>::tryInsert(const T& value)
+HashTable<T, K, KEY_OF>::tryInsert(const T& value)
 {
-    auto f = search(value);
+    auto f = search(KEY_OF::get(value));
     if (f.pData) return f;
     else return insert(value);
 }
 
+template<typename T, typename K, typename KEY_OF>
+inline void
+HashTable<T, K, KEY_OF>::destroy()
+{
+    _pAlloc->free(_pSlots);
+    _pAlloc->free(_pCtrl);
+    _pSlots = nullptr;
+    _pCtrl = nullptr;
+}
+
+/* set of `T` */
+template<typename T>
+using HashMap = HashTable<T>;
+
+template<typename K, typename V>
+struct MapEntry
+{
+    K key;
+    V val;
+};
+
+template<typename K, typename V>
+struct MapEntryKey
+{
+    static const K& get(const MapEntry<K, V>& e) { return e.key; }
+};
+
+/* key/value variant, hashed and compared by key only */
+template<typename K, typename V>
+struct Map : HashTable<MapEntry<K, V>, K, MapEntryKey<K, V>>
+{
+    using Base = HashTable<MapEntry<K, V>, K, MapEntryKey<K, V>>;
+    using Base::Base;
+    using Base::insert;
+    using Base::tryInsert;
+
+    HashMapRet<MapEntry<K, V>> insert(const K& key, const V& val) { return Base::insert({key, val}); }
+    HashMapRet<MapEntry<K, V>> tryInsert(const K& key, const V& val) { return Base::tryInsert({key, val}); }
+};
+
 } /* namespace adt */
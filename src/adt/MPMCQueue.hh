@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+#include "Allocator.hh"
+#include "utils.hh"
+
+namespace adt
+{
+
+template<typename T>
+struct MPMCCell
+{
+    std::atomic<u64> seq; /* == position: free for the producer of that position, == position + 1: full */
+    T data;
+};
+
+/* Bounded lock-free queue for any number of producers and consumers (Vyukov's sequence numbered ring).
+ * Each slot's sequence number says whose turn it is, so producers and consumers only race on their own
+ * end index and never on each other's. Capacity is rounded up to a power of two and fixed, push fails when
+ * full instead of growing. Batch versions claim a run of slots with one cas. */
+template<typename T>
+struct MPMCQueue
+{
+    static_assert(std::is_trivially_copyable_v<T>, "slots are copied without constructors");
+
+    alignas(64) std::atomic<u64> _tail {}; /* next position to push */
+    alignas(64) std::atomic<u64> _head {}; /* next position to pop */
+    alignas(64) Allocator* _pAlloc {};
+    MPMCCell<T>* _pCells {};
+    u64 _mask {};
+
+    MPMCQueue() = default;
+    MPMCQueue(Allocator* p, u32 capacity);
+
+    bool push(const T& val); /* false if full */
+    bool pop(T* pVal); /* false if empty */
+    u32 pushBatch(const T* pData, u32 size); /* pushes up to `size` in order, returns how many */
+    u32 popBatch(T* pData, u32 maxSize); /* returns how many */
+    u32 capacity() const { return _mask + 1; }
+    u32 sizeApprox() const;
+    void destroy() { _pAlloc->free(_pCells); }
+};
+
+template<typename T>
+inline
+MPMCQueue<T>::MPMCQueue(Allocator* p, u32 capacity)
+    : _pAlloc(p)
+{
+    u64 cap = capacity < 2 ? 2 : u64(1) << (64 - __builtin_clzll(u64(capacity) - 1));
+    _mask = cap - 1;
+    _pCells = (MPMCCell<T>*)p->alloc(cap, sizeof(MPMCCell<T>));
+    for (u64 i = 0; i < cap; i++)
+        _pCells[i].seq.store(i, std::memory_order_relaxed);
+}
+
+template<typename T>
+inline bool
+MPMCQueue<T>::push(const T& val)
+{
+    return pushBatch(&val, 1) == 1;
+}
+
+template<typename T>
+inline bool
+MPMCQueue<T>::pop(T* pVal)
+{
+    return popBatch(pVal, 1) == 1;
+}
+
+template<typename T>
+inline u32
+MPMCQueue<T>::pushBatch(const T* pData, u32 size)
+{
+    u64 pos = _tail.load(std::memory_order_relaxed);
+    u32 n = 0;
+
+    while (size > 0)
+    {
+        /* run of free slots starting at `pos`, sequence numbers never go back so they stay ours once claimed */
+        for (n = 0; n < size && n <= _mask; n++)
+        {
+            u64 seq = _pCells[(pos + n) & _mask].seq.load(std::memory_order_acquire);
+            if (seq != pos + n) break;
+        }
+
+        if (n == 0)
+        {
+            u64 seq = _pCells[pos & _mask].seq.load(std::memory_order_acquire);
+            if (s64(seq - pos) < 0)
+                return 0; /* full */
+
+            pos = _tail.load(std::memory_order_relaxed); /* another producer got it */
+            continue;
+        }
+
+        if (_tail.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed, std::memory_order_relaxed))
+            break;
+    }
+
+    for (u32 i = 0; i < n; i++)
+    {
+        MPMCCell<T>& c = _pCells[(pos + i) & _mask];
+        c.data = pData[i];
+        c.seq.store(pos + i + 1, std::memory_order_release);
+    }
+
+    return n;
+}
+
+template<typename T>
+inline u32
+MPMCQueue<T>::popBatch(T* pData, u32 maxSize)
+{
+    u64 pos = _head.load(std::memory_order_relaxed);
+    u32 n = 0;
+
+    while (maxSize > 0)
+    {
+        for (n = 0; n < maxSize && n <= _mask; n++)
+        {
+            u64 seq = _pCells[(pos + n) & _mask].seq.load(std::memory_order_acquire);
+            if (seq != pos + n + 1) break;
+        }
+
+        if (n == 0)
+        {
+            u64 seq = _pCells[pos & _mask].seq.load(std::memory_order_acquire);
+            if (s64(seq - (pos + 1)) < 0)
+                return 0; /* empty */
+
+            pos = _head.load(std::memory_order_relaxed);
+            continue;
+        }
+
+        if (_head.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed, std::memory_order_relaxed))
+            break;
+    }
+
+    for (u32 i = 0; i < n; i++)
+    {
+        MPMCCell<T>& c = _pCells[(pos + i) & _mask];
+        pData[i] = c.data;
+        /* free for the producer one lap later */
+        c.seq.store(pos + i + _mask + 1, std::memory_order_release);
+    }
+
+    return n;
+}
+
+template<typename T>
+inline u32
+MPMCQueue<T>::sizeApprox() const
+{
+    u64 h = _head.load(std::memory_order_relaxed);
+    u64 t = _tail.load(std::memory_order_relaxed);
+    return t > h ? u32(t - h) : 0;
+}
+
+} /* namespace adt */
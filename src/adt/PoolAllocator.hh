@@ -0,0 +1,231 @@
+#pragma once
+
+#include <string.h>
+#include <stddef.h>
+
+#include "Allocator.hh"
+#include "ultratypes.h"
+
+namespace adt
+{
+
+constexpr u32 POOL_MIN_CLASS_SHIFT = 4; /* 16 byte slots, header included */
+constexpr u32 POOL_MAX_CLASS_SHIFT = 16; /* bigger allocations go to malloc */
+constexpr u32 POOL_CLASS_COUNT = POOL_MAX_CLASS_SHIFT - POOL_MIN_CLASS_SHIFT + 1;
+constexpr u64 POOL_LARGE = u64(-1);
+constexpr size_t POOL_SLAB_SIZE = 256 * SIZE_1K;
+
+struct PoolNode
+{
+    u64 sizeClass; /* index into `_aClasses` or `POOL_LARGE`, 8 byte alignment for allocators */
+    u8 pData[];
+};
+
+/* malloc'd allocation, linked for `freeAll()` */
+struct PoolLargeNode
+{
+    PoolLargeNode* pPrev;
+    PoolLargeNode* pNext;
+    PoolNode node;
+};
+
+struct PoolFreeSlot
+{
+    PoolFreeSlot* pNext;
+};
+
+struct PoolSlab
+{
+    PoolSlab* pNext;
+    u64 _pad; /* keep slots 16 byte aligned */
+    u8 pData[];
+};
+
+struct PoolClass
+{
+    PoolFreeSlot* pFree; /* intrusive free list */
+    u8* pCarve; /* rest of the latest slab, slots are cut off lazily */
+    u8* pCarveEnd;
+};
+
+/* Size-class allocator: power-of-two slots from 16 bytes to 64K carved from 256K slabs, with one free list
+ * per class. `free()` pushes the slot back, `realloc()` stays in place while the size fits the slot and
+ * otherwise moves to a bigger class and recycles the old slot, so growing arrays don't leave garbage behind
+ * like they do in an arena. Memory is zeroed like calloc(). Not thread safe. */
+struct PoolAllocator : Allocator
+{
+    PoolClass _aClasses[POOL_CLASS_COUNT] {};
+    PoolSlab* _pSlabs {};
+    PoolLargeNode* _pLarge {};
+
+    PoolAllocator() = default;
+
+    virtual void* alloc(size_t memberCount, size_t memberSize) override final;
+    virtual void free(void* p) override final;
+    virtual void* realloc(void* p, size_t size) override final;
+    void freeAll();
+
+private:
+    static u32 classOf(size_t size);
+    static size_t slotSize(u32 cls) { return size_t(1) << (cls + POOL_MIN_CLASS_SHIFT); }
+    static PoolNode* ptrToNode(const void* p) { return (PoolNode*)((u8*)p - sizeof(PoolNode)); }
+
+    PoolNode* allocSlot(u32 cls);
+    void* allocLarge(size_t size);
+    size_t usable(PoolNode* pNode);
+};
+
+/* smallest class that fits `size` bytes plus header, `POOL_CLASS_COUNT` if none does */
+inline u32
+PoolAllocator::classOf(size_t size)
+{
+    size_t total = size + sizeof(PoolNode);
+    if (total > slotSize(POOL_CLASS_COUNT - 1)) return POOL_CLASS_COUNT;
+    if (total <= slotSize(0)) return 0;
+
+    return (64 - __builtin_clzll(total - 1)) - POOL_MIN_CLASS_SHIFT;
+}
+
+inline PoolNode*
+PoolAllocator::allocSlot(u32 cls)
+{
+    PoolClass& c = _aClasses[cls];
+
+    if (c.pFree)
+    {
+        auto* pSlot = c.pFree;
+        c.pFree = pSlot->pNext;
+        return (PoolNode*)pSlot;
+    }
+
+    size_t size = slotSize(cls);
+    if (!c.pCarve || c.pCarve + size > c.pCarveEnd)
+    {
+        auto* pSlab = (PoolSlab*)::malloc(sizeof(PoolSlab) + POOL_SLAB_SIZE);
+        pSlab->pNext = _pSlabs;
+        _pSlabs = pSlab;
+
+        c.pCarve = pSlab->pData;
+        c.pCarveEnd = pSlab->pData + POOL_SLAB_SIZE;
+    }
+
+    auto* pNode = (PoolNode*)c.pCarve;
+    c.pCarve += size;
+
+    return pNode;
+}
+
+inline void*
+PoolAllocator::allocLarge(size_t size)
+{
+    auto* pL = (PoolLargeNode*)::calloc(1, sizeof(PoolLargeNode) + size);
+    pL->pNext = _pLarge;
+    if (_pLarge) _pLarge->pPrev = pL;
+    _pLarge = pL;
+    pL->node.sizeClass = POOL_LARGE;
+
+    return pL->node.pData;
+}
+
+inline size_t
+PoolAllocator::usable(PoolNode* pNode)
+{
+    assert(pNode->sizeClass != POOL_LARGE);
+    return slotSize(pNode->sizeClass) - sizeof(PoolNode);
+}
+
+inline void*
+PoolAllocator::alloc(size_t memberCount, size_t memberSize)
+{
+    size_t size = memberCount * memberSize;
+    u32 cls = classOf(size);
+
+    if (cls == POOL_CLASS_COUNT)
+        return allocLarge(size);
+
+    PoolNode* pNode = allocSlot(cls);
+    pNode->sizeClass = cls;
+    memset(pNode->pData, 0, size);
+
+    return pNode->pData;
+}
+
+inline void
+PoolAllocator::free(void* p)
+{
+    if (!p) return;
+
+    PoolNode* pNode = ptrToNode(p);
+
+    if (pNode->sizeClass == POOL_LARGE)
+    {
+        auto* pL = (PoolLargeNode*)((u8*)pNode - offsetof(PoolLargeNode, node));
+        if (pL->pPrev) pL->pPrev->pNext = pL->pNext;
+        else _pLarge = pL->pNext;
+        if (pL->pNext) pL->pNext->pPrev = pL->pPrev;
+
+        ::free(pL);
+        return;
+    }
+
+    PoolClass& c = _aClasses[pNode->sizeClass];
+    auto* pSlot = (PoolFreeSlot*)pNode;
+    pSlot->pNext = c.pFree;
+    c.pFree = pSlot;
+}
+
+inline void*
+PoolAllocator::realloc(void* p, size_t size)
+{
+    if (!p) return alloc(1, size);
+
+    PoolNode* pNode = ptrToNode(p);
+
+    if (pNode->sizeClass == POOL_LARGE)
+    {
+        if (classOf(size) == POOL_CLASS_COUNT)
+        {
+            auto* pL = (PoolLargeNode*)((u8*)pNode - offsetof(PoolLargeNode, node));
+            auto* pNew = (PoolLargeNode*)::realloc(pL, sizeof(PoolLargeNode) + size);
+
+            if (pNew->pPrev) pNew->pPrev->pNext = pNew;
+            else _pLarge = pNew;
+            if (pNew->pNext) pNew->pNext->pPrev = pNew;
+
+            return pNew->node.pData;
+        }
+
+        /* shrinking out of the large range is rare enough to keep the block */
+        return p;
+    }
+
+    size_t oldSize = usable(pNode);
+    if (size <= oldSize)
+        return p;
+
+    void* pR = alloc(1, size);
+    memcpy(pR, p, oldSize);
+    free(p);
+
+    return pR;
+}
+
+inline void
+PoolAllocator::freeAll()
+{
+    for (PoolSlab* pS = _pSlabs, * pNext = nullptr; pS; pS = pNext)
+    {
+        pNext = pS->pNext;
+        ::free(pS);
+    }
+
+    for (PoolLargeNode* pL = _pLarge, * pNext = nullptr; pL; pL = pNext)
+    {
+        pNext = pL->pNext;
+        ::free(pL);
+    }
+
+    *this = {};
+}
+
+} /* namespace adt */
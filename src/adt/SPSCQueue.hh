@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+#include "Allocator.hh"
+#include "utils.hh"
+
+namespace adt
+{
+
+/* Bounded wait-free queue for exactly one producer and one consumer thread, e.g. between two pipeline stages.
+ * Each side keeps a cached copy of the other's index and rereads it only when the ring looks full or empty,
+ * so in the steady state neither side touches the other's cache line. Capacity is rounded up to a power of two. */
+template<typename T>
+struct SPSCQueue
+{
+    static_assert(std::is_trivially_copyable_v<T>, "slots are copied without constructors");
+
+    alignas(64) std::atomic<u64> _tail {}; /* producer writes */
+    u64 _headCache {}; /* producer's view of `_head` */
+    alignas(64) std::atomic<u64> _head {}; /* consumer writes */
+    u64 _tailCache {}; /* consumer's view of `_tail` */
+    alignas(64) Allocator* _pAlloc {};
+    T* _pData {};
+    u64 _mask {};
+
+    SPSCQueue() = default;
+    SPSCQueue(Allocator* p, u32 capacity);
+
+    bool push(const T& val) { return pushBatch(&val, 1) == 1; } /* producer only, false if full */
+    bool pop(T* pVal) { return popBatch(pVal, 1) == 1; } /* consumer only, false if empty */
+    u32 pushBatch(const T* pData, u32 size); /* producer only, returns how many */
+    u32 popBatch(T* pData, u32 maxSize); /* consumer only, returns how many */
+    u32 capacity() const { return _mask + 1; }
+    bool empty() const { return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire); } /* exact for the consumer */
+    void destroy() { _pAlloc->free(_pData); }
+};
+
+template<typename T>
+inline
+SPSCQueue<T>::SPSCQueue(Allocator* p, u32 capacity)
+    : _pAlloc(p)
+{
+    u64 cap = capacity < 2 ? 2 : u64(1) << (64 - __builtin_clzll(u64(capacity) - 1));
+    _mask = cap - 1;
+    _pData = (T*)p->alloc(cap, sizeof(T));
+}
+
+template<typename T>
+inline u32
+SPSCQueue<T>::pushBatch(const T* pData, u32 size)
+{
+    u64 t = _tail.load(std::memory_order_relaxed);
+    u64 free = _mask + 1 - (t - _headCache);
+
+    if (free < size)
+    {
+        _headCache = _head.load(std::memory_order_acquire);
+        free = _mask + 1 - (t - _headCache);
+    }
+
+    u32 n = size < free ? size : u32(free);
+    for (u32 i = 0; i < n; i++)
+        _pData[(t + i) & _mask] = pData[i];
+
+    _tail.store(t + n, std::memory_order_release);
+
+    return n;
+}
+
+template<typename T>
+inline u32
+SPSCQueue<T>::popBatch(T* pData, u32 maxSize)
+{
+    u64 h = _head.load(std::memory_order_relaxed);
+    u64 avail = _tailCache - h;
+
+    if (avail < maxSize)
+    {
+        _tailCache = _tail.load(std::memory_order_acquire);
+        avail = _tailCache - h;
+    }
+
+    u32 n = maxSize < avail ? maxSize : u32(avail);
+    for (u32 i = 0; i < n; i++)
+        pData[i] = _pData[(h + i) & _mask];
+
+    _head.store(h + n, std::memory_order_release);
+
+    return n;
+}
+
+} /* namespace adt */
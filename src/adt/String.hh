@@ -140,17 +140,17 @@ makeString(Allocator* p, String s)
 }
 
 template<>
-constexpr size_t
+constexpr u64
 fnHash<String>(String& str)
 {
-    return hashFNV(str._pData, str._size);
+    return hashWY(str._pData, str._size);
 }
 
 template<>
-constexpr size_t
+constexpr u64
 fnHash<const String>(const String& str)
 {
-    return hashFNV(str._pData, str._size);
+    return hashWY(str._pData, str._size);
 }
 
 constexpr size_t
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "ArenaAllocator.hh"
+
+namespace adt
+{
+
+constexpr u32 THREAD_ARENA_DEFAULT_MAX_THREADS = 256;
+
+struct ThreadArenaBlock
+{
+    ThreadArenaBlock* pNextAll = nullptr; /* every block, for `reset()`/`freeAll()` */
+    ThreadArenaBlock* pNextFree = nullptr; /* free stack, only popped while allocating */
+    size_t size = 0;
+    size_t dirty = 0; /* high water mark, `pData` past it is still zero from calloc */
+    bool bHuge = false; /* single allocation bigger than a block, not reused */
+    alignas(8) u8 pData[];
+};
+
+/* one thread's bump state, on its own cache line */
+struct alignas(64) ThreadArena
+{
+    std::atomic<void*> pOwner {}; /* address of the owner's `g_tThreadArenaCache` */
+    ThreadArenaBlock* pBlock {};
+    size_t pos {};
+    ArenaNode* pLastAlloc {};
+};
+
+struct ThreadArenaCache
+{
+    u64 gen;
+    ThreadArena* pArena;
+};
+
+/* last used allocator generation and this thread's slot in it */
+inline thread_local ThreadArenaCache g_tThreadArenaCache {};
+/* generations are unique across all instances, so a stale cache never matches a new or reset allocator */
+inline std::atomic<u64> g_threadArenaGen {1};
+
+/* Arena for many threads allocating at once without a lock.
+ * Each thread claims a slot on its first `alloc()` and bumps its own block, full blocks are replaced by popping the
+ * shared free stack (pop only, so no ABA) or allocating a new one, which is pushed to the list of all blocks.
+ * Lookup is one thread_local compare. `reset()` and `freeAll()` reclaim everything from all threads,
+ * they must not run concurrently with allocations. Like `ArenaAllocator` only the calling thread's most recent
+ * allocation can grow in place or be freed, and memory is zeroed. Freeing from a thread that never allocated is a
+ * no-op. Slots are held until `release()` from the owning thread or `reset()`. When all `maxThreads` are taken
+ * the rest of the threads share one overflow slot under a mutex, slower but never failing. */
+struct ThreadArenaAllocator : Allocator
+{
+    ThreadArena* _pSlots {}; /* `maxThreads` + 1, the last one is the overflow slot */
+    u32 _maxThreads {};
+    size_t _blockSize {};
+    u64 _gen {};
+    std::atomic<ThreadArenaBlock*> _pAll {};
+    std::atomic<ThreadArenaBlock*> _pFree {};
+    mtx_t _mtxOverflow; /* for threads that found no free slot */
+
+    ThreadArenaAllocator() = default;
+    ThreadArenaAllocator(u32 blockSize, u32 maxThreads = THREAD_ARENA_DEFAULT_MAX_THREADS);
+
+    virtual void* alloc(size_t memberCount, size_t memberSize) override final;
+    virtual void free(void* p) override final;
+    virtual void* realloc(void* p, size_t size) override final;
+    void release(); /* gives the calling thread's slot back, its allocations stay valid */
+    void reset();
+    void freeAll();
+
+private:
+    ThreadArena* local();
+    ThreadArena* find();
+    ThreadArena* claim();
+    void refill(ThreadArena* pA);
+    void* bump(ThreadArena* pA, size_t requested, size_t aligned);
+    void* allocHuge(size_t requested, size_t aligned);
+    ThreadArenaBlock* newBlock(size_t size);
+};
+
+inline
+ThreadArenaAllocator::ThreadArenaAllocator(u32 blockSize, u32 maxThreads)
+    : _maxThreads(maxThreads), _blockSize(ALIGN_TO_8_BYTES(blockSize + sizeof(ArenaNode))), _gen(g_threadArenaGen++)
+{
+    _pSlots = (ThreadArena*)::aligned_alloc(alignof(ThreadArena), sizeof(ThreadArena) * (maxThreads + 1));
+    for (u32 i = 0; i <= maxThreads; i++)
+        new(&_pSlots[i]) ThreadArena {};
+
+    mtx_init(&_mtxOverflow, mtx_plain);
+}
+
+/* this thread's slot, claims one if it has none, nullptr if all are taken */
+inline ThreadArena*
+ThreadArenaAllocator::local()
+{
+    auto& c = g_tThreadArenaCache;
+    if (c.gen == _gen) return c.pArena;
+
+    ThreadArena* pA = find();
+    return pA ? pA : claim();
+}
+
+/* this thread's slot or nullptr, never claims */
+inline ThreadArena*
+ThreadArenaAllocator::find()
+{
+    auto& c = g_tThreadArenaCache;
+    if (c.gen == _gen) return c.pArena;
+
+    for (u32 i = 0; i < _maxThreads; i++)
+    {
+        if (_pSlots[i].pOwner.load(std::memory_order_relaxed) == &c)
+        {
+            c = {_gen, &_pSlots[i]};
+            return &_pSlots[i];
+        }
+    }
+
+    return nullptr;
+}
+
+inline ThreadArena*
+ThreadArenaAllocator::claim()
+{
+    void* pMe = &g_tThreadArenaCache;
+
+    for (u32 i = 0; i < _maxThreads; i++)
+    {
+        void* pNone = nullptr;
+        if (_pSlots[i].pOwner.compare_exchange_strong(pNone, pMe, std::memory_order_acq_rel))
+        {
+            g_tThreadArenaCache = {_gen, &_pSlots[i]};
+            return &_pSlots[i];
+        }
+    }
+
+    return nullptr;
+}
+
+inline ThreadArenaBlock*
+ThreadArenaAllocator::newBlock(size_t size)
+{
+    auto* pB = (ThreadArenaBlock*)::calloc(1, sizeof(ThreadArenaBlock) + size);
+    pB->size = size;
+
+    /* push only list */
+    pB->pNextAll = _pAll.load(std::memory_order_relaxed);
+    while (!_pAll.compare_exchange_weak(pB->pNextAll, pB, std::memory_order_release, std::memory_order_relaxed))
+        ;
+
+    return pB;
+}
+
+inline void
+ThreadArenaAllocator::refill(ThreadArena* pA)
+{
+    ThreadArenaBlock* pB = _pFree.load(std::memory_order_acquire);
+    while (pB && !_pFree.compare_exchange_weak(pB, pB->pNextFree, std::memory_order_acquire, std::memory_order_acquire))
+        ;
+
+    if (!pB) pB = newBlock(_blockSize);
+
+    pA->pBlock = pB;
+    pA->pos = 0;
+    pA->pLastAlloc = nullptr;
+}
+
+inline void*
+ThreadArenaAllocator::allocHuge(size_t requested, size_t aligned)
+{
+    ThreadArenaBlock* pB = newBlock(aligned);
+    pB->bHuge = true;
+
+    auto* pNode = (ArenaNode*)pB->pData;
+    pNode->size = requested;
+
+    return pNode->pData;
+}
+
+inline void*
+ThreadArenaAllocator::alloc(size_t memberCount, size_t memberSize)
+{
+    size_t requested = memberCount * memberSize;
+    size_t aligned = ALIGN_TO_8_BYTES(requested + sizeof(ArenaNode));
+
+    if (aligned > _blockSize)
+        return allocHuge(requested, aligned);
+
+    ThreadArena* pA = local();
+    if (pA) return bump(pA, requested, aligned);
+
+    mtx_lock(&_mtxOverflow);
+    void* p = bump(&_pSlots[_maxThreads], requested, aligned);
+    mtx_unlock(&_mtxOverflow);
+
+    return p;
+}
+
+inline void*
+ThreadArenaAllocator::bump(ThreadArena* pA, size_t requested, size_t aligned)
+{
+    if (!pA->pBlock || pA->pos + aligned > pA->pBlock->size)
+        refill(pA);
+
+    ThreadArenaBlock* pB = pA->pBlock;
+    auto* pNode = (ArenaNode*)&pB->pData[pA->pos];
+    if (pA->pos < pB->dirty)
+        memset(pNode, 0, pB->dirty - pA->pos < aligned ? pB->dirty - pA->pos : aligned);
+
+    pA->pos += aligned;
+    if (pA->pos > pB->dirty) pB->dirty = pA->pos;
+
+    pNode->size = requested;
+    pA->pLastAlloc = pNode;
+
+    return pNode->pData;
+}
+
+inline void
+ThreadArenaAllocator::free(void* p)
+{
+    if (!p) return;
+
+    ThreadArena* pA = find();
+    ArenaNode* pNode = (ArenaNode*)((u8*)p - offsetof(ArenaNode, pData));
+
+    if (pA && pNode == pA->pLastAlloc)
+    {
+        pA->pos = (u8*)pNode - pA->pBlock->pData;
+        pA->pLastAlloc = nullptr;
+    }
+}
+
+inline void*
+ThreadArenaAllocator::realloc(void* p, size_t size)
+{
+    if (!p) return alloc(1, size);
+
+    ThreadArena* pA = find();
+    ArenaNode* pNode = (ArenaNode*)((u8*)p - offsetof(ArenaNode, pData));
+
+    if (pA && pNode == pA->pLastAlloc)
+    {
+        ThreadArenaBlock* pB = pA->pBlock;
+        size_t end = ((u8*)pNode - pB->pData) + ALIGN_TO_8_BYTES(size + sizeof(ArenaNode));
+
+        if (end <= pB->size)
+        {
+            pA->pos = end;
+            if (end > pB->dirty) pB->dirty = end;
+            pNode->size = size;
+
+            return p;
+        }
+    }
+    else if (size <= pNode->size)
+    {
+        return p;
+    }
+
+    /* foreign or not the last one, copy into this thread's own memory */
+    void* pR = alloc(1, size);
+    if (!pR) return nullptr;
+
+    memcpy(pR, p, pNode->size < size ? pNode->size : size);
+
+    return pR;
+}
+
+inline void
+ThreadArenaAllocator::release()
+{
+    ThreadArena* pA = find();
+    if (!pA) return;
+
+    /* next owner keeps bumping the same block, past everything allocated here */
+    pA->pLastAlloc = nullptr;
+    pA->pOwner.store(nullptr, std::memory_order_release);
+    g_tThreadArenaCache = {};
+}
+
+inline void
+ThreadArenaAllocator::reset()
+{
+    ThreadArenaBlock* pB = _pAll.load(std::memory_order_acquire);
+    ThreadArenaBlock* pAll = nullptr;
+    ThreadArenaBlock* pFree = nullptr;
+
+    while (pB)
+    {
+        ThreadArenaBlock* pNext = pB->pNextAll;
+
+        if (pB->bHuge)
+        {
+            ::free(pB);
+        }
+        else
+        {
+            pB->pNextAll = pAll;
+            pAll = pB;
+            pB->pNextFree = pFree;
+            pFree = pB;
+        }
+
+        pB = pNext;
+    }
+
+    _pAll.store(pAll, std::memory_order_relaxed);
+    _pFree.store(pFree, std::memory_order_relaxed);
+
+    for (u32 i = 0; i <= _maxThreads; i++)
+        new(&_pSlots[i]) ThreadArena {};
+
+    _gen = g_threadArenaGen++;
+}
+
+inline void
+ThreadArenaAllocator::freeAll()
+{
+    ThreadArenaBlock* pB = _pAll.load(std::memory_order_acquire);
+    while (pB)
+    {
+        ThreadArenaBlock* pNext = pB->pNextAll;
+        ::free(pB);
+        pB = pNext;
+    }
+
+    _pAll.store(nullptr, std::memory_order_relaxed);
+    _pFree.store(nullptr, std::memory_order_relaxed);
+    ::free(_pSlots);
+    _pSlots = nullptr;
+    mtx_destroy(&_mtxOverflow);
+}
+
+} /* namespace adt */
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <atomic>
+#include <new>
+#include <stdlib.h>
 #include <threads.h>
+#include <utility>
 
 #include "Queue.hh"
 
@@ -28,46 +31,191 @@ getLogicalCoresCountWIN32()
 namespace adt
 {
 
+constexpr u32 THREAD_POOL_DEQUE_SIZE = 1024; /* power of two, full deques spill into the injection queue */
+constexpr u32 THREAD_POOL_SPIN_ROUNDS = 64; /* failed searches before an idle worker parks */
+
+/* Tasks that finish together. Counter only, can live anywhere, see `ThreadPool::waitFor()`. */
+struct TaskGroup
+{
+    std::atomic<u32> _nPending {};
+
+    bool done() const { return _nPending.load(std::memory_order_acquire) == 0; }
+};
+
 struct TaskNode
 {
     thrd_start_t pfn;
     void* pArgs;
+    TaskGroup* pGroup {};
+};
+
+/* thieves read slots while the owner may be writing them, the winner is decided by the cas on `_top` */
+struct TaskSlot
+{
+    std::atomic<thrd_start_t> pfn;
+    std::atomic<void*> pArgs;
+    std::atomic<TaskGroup*> pGroup;
+};
+
+/* Fixed size Chase-Lev deque (Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+ * Owner pushes and pops at the bottom (LIFO, cache warm), thieves steal from the top (FIFO, oldest and
+ * usually biggest tasks). No resizing, so slots are never freed under a thief. */
+struct TaskDeque
+{
+    alignas(64) std::atomic<s64> _top {};
+    alignas(64) std::atomic<s64> _bottom {};
+    TaskSlot* _pSlots {};
+
+    bool push(TaskNode task); /* owner only, false if full */
+    bool pop(TaskNode* pTask); /* owner only */
+    bool steal(TaskNode* pTask); /* any thread, false if empty or lost a race */
+    bool empty() const { return _top.load(std::memory_order_relaxed) >= _bottom.load(std::memory_order_relaxed); }
+};
+
+inline bool
+TaskDeque::push(TaskNode task)
+{
+    s64 b = _bottom.load(std::memory_order_relaxed);
+    s64 t = _top.load(std::memory_order_acquire);
+
+    if (b - t >= s64(THREAD_POOL_DEQUE_SIZE))
+        return false;
+
+    TaskSlot& s = _pSlots[b & (THREAD_POOL_DEQUE_SIZE - 1)];
+    s.pfn.store(task.pfn, std::memory_order_relaxed);
+    s.pArgs.store(task.pArgs, std::memory_order_relaxed);
+    s.pGroup.store(task.pGroup, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(b + 1, std::memory_order_relaxed);
+
+    return true;
+}
+
+inline bool
+TaskDeque::pop(TaskNode* pTask)
+{
+    s64 b = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    s64 t = _top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        _bottom.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    TaskSlot& s = _pSlots[b & (THREAD_POOL_DEQUE_SIZE - 1)];
+    pTask->pfn = s.pfn.load(std::memory_order_relaxed);
+    pTask->pArgs = s.pArgs.load(std::memory_order_relaxed);
+    pTask->pGroup = s.pGroup.load(std::memory_order_relaxed);
+
+    if (t == b)
+    {
+        /* last one, race the thieves for it */
+        bool bWon = _top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        _bottom.store(b + 1, std::memory_order_relaxed);
+        return bWon;
+    }
+
+    return true;
+}
+
+inline bool
+TaskDeque::steal(TaskNode* pTask)
+{
+    s64 t = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    s64 b = _bottom.load(std::memory_order_acquire);
+
+    if (t >= b)
+        return false;
+
+    TaskSlot& s = _pSlots[t & (THREAD_POOL_DEQUE_SIZE - 1)];
+    pTask->pfn = s.pfn.load(std::memory_order_relaxed);
+    pTask->pArgs = s.pArgs.load(std::memory_order_relaxed);
+    pTask->pGroup = s.pGroup.load(std::memory_order_relaxed);
+
+    return _top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+struct ThreadPool;
+
+struct alignas(64) ThreadPoolWorker
+{
+    TaskDeque q {};
+    ThreadPool* pPool {};
+    u32 idx {};
 };
 
+/* worker the current thread runs as, null outside of pools */
+inline thread_local ThreadPoolWorker* g_tThreadPoolWorker {};
+/* victim selection, xorshift */
+inline thread_local u64 g_tThreadPoolRng = 0x9E3779B97F4A7C15;
+
+/* Work-stealing pool. Tasks submitted from a worker go to its own deque, from anywhere else (or when the deque
+ * is full) to the shared injection queue. Idle workers take from their deque, then the injection queue, then
+ * steal from randomly picked workers. After `THREAD_POOL_SPIN_ROUNDS` failed searches they park on `_cndSleep`,
+ * submit only touches the sleep mutex when someone is parked. */
 struct ThreadPool
 {
     Allocator* _pAlloc {};
-    Queue<TaskNode> _qTasks;
+    ThreadPoolWorker* _pWorkers {};
     thrd_t* _pThreads {};
     u32 _threadCount {};
-    cnd_t _cndQ, _cndWait;
-    mtx_t _mtxQ, _mtxWait;
-    std::atomic<int> _activeTaskCount;
-    bool _bDone {};
+    Queue<TaskNode> _qTasks; /* injection queue, under `_mtxQ` */
+    mtx_t _mtxQ;
+    std::atomic<u32> _nInjected {};
+    cnd_t _cndSleep, _cndWait;
+    mtx_t _mtxSleep, _mtxWait;
+    std::atomic<u32> _nSleeping {};
+    std::atomic<u64> _nPending {}; /* submitted and not finished */
+    std::atomic<bool> _bDone {};
 
     ThreadPool() = default;
     ThreadPool(Allocator* p, u32 _threadCount);
     ThreadPool(Allocator* p);
 
     void start();
-    bool busy();
+    bool busy() { return _nPending.load(std::memory_order_acquire) > 0; }
     void submit(thrd_start_t pfnTask, void* pArgs) { submit({pfnTask, pArgs}); }
+    void submit(TaskGroup* pGroup, thrd_start_t pfnTask, void* pArgs) { submit({pfnTask, pArgs, pGroup}); }
     void submit(TaskNode task);
-    void wait();
+    void wait(); /* until the whole pool is idle */
+    void waitFor(TaskGroup* pGroup) { helpWhile(&pGroup->_nPending); } /* until `pGroup` is done, running tasks meanwhile */
+    bool runOne(); /* runs one pending task on the calling thread, false if none found */
+    void helpWhile(const std::atomic<u32>* pCount); /* runs pending tasks until `*pCount` drops to zero */
+    bool localEmpty(); /* nothing queued where the caller's next submit goes, so splitting work pays off */
     void destroy();
 
 private:
     void stop();
+    bool findTask(ThreadPoolWorker* pW, TaskNode* pTask);
+    bool hasWork();
+    void run(TaskNode task);
+    void wake();
+    void park();
     static int loop(void* _self);
 };
 
 inline
 ThreadPool::ThreadPool(Allocator* p, u32 _threadCount)
-    : _pAlloc(p), _qTasks(p, _threadCount), _threadCount(_threadCount), _activeTaskCount(0), _bDone(false)
+    : _pAlloc(p), _threadCount(_threadCount), _qTasks(p, _threadCount)
 {
     _pThreads = (thrd_t*)p->alloc(_threadCount, sizeof(thrd_t));
-    cnd_init(&_cndQ);
+    /* deque indices sit on their own cache lines, `Allocator` doesn't do over-alignment */
+    _pWorkers = (ThreadPoolWorker*)::aligned_alloc(alignof(ThreadPoolWorker), sizeof(ThreadPoolWorker) * _threadCount);
+    for (u32 i = 0; i < _threadCount; i++)
+    {
+        new(&_pWorkers[i]) ThreadPoolWorker {};
+        _pWorkers[i].q._pSlots = (TaskSlot*)p->alloc(THREAD_POOL_DEQUE_SIZE, sizeof(TaskSlot));
+        _pWorkers[i].pPool = this;
+        _pWorkers[i].idx = i;
+    }
+
     mtx_init(&_mtxQ, mtx_plain);
+    cnd_init(&_cndSleep);
+    mtx_init(&_mtxSleep, mtx_plain);
     cnd_init(&_cndWait);
     mtx_init(&_mtxWait, mtx_plain);
 }
@@ -79,82 +227,215 @@ ThreadPool::ThreadPool(Allocator* p)
 inline void
 ThreadPool::start()
 {
-    for (size_t i = 0; i < _threadCount; i++)
-        thrd_create(&_pThreads[i], ThreadPool::loop, this);
+    for (u32 i = 0; i < _threadCount; i++)
+        thrd_create(&_pThreads[i], ThreadPool::loop, &_pWorkers[i]);
+}
+
+inline bool
+ThreadPool::findTask(ThreadPoolWorker* pW, TaskNode* pTask)
+{
+    if (pW && pW->q.pop(pTask))
+        return true;
+
+    if (_nInjected.load(std::memory_order_acquire) > 0)
+    {
+        mtx_lock(&_mtxQ);
+        bool bGot = !_qTasks.empty();
+        if (bGot)
+        {
+            *pTask = *_qTasks.popFront();
+            _nInjected.fetch_sub(1, std::memory_order_relaxed);
+        }
+        mtx_unlock(&_mtxQ);
+
+        if (bGot) return true;
+    }
+
+    u64 r = g_tThreadPoolRng;
+    r ^= r << 13;
+    r ^= r >> 7;
+    r ^= r << 17;
+    g_tThreadPoolRng = r;
+
+    u32 start = u32(r % _threadCount);
+    for (u32 i = 0; i < _threadCount; i++)
+    {
+        ThreadPoolWorker* pVictim = &_pWorkers[(start + i) % _threadCount];
+        if (pVictim != pW && pVictim->q.steal(pTask))
+            return true;
+    }
+
+    return false;
 }
 
 inline bool
-ThreadPool::busy()
+ThreadPool::hasWork()
 {
-    mtx_lock(&_mtxQ);
-    bool ret = !_qTasks.empty() || _activeTaskCount > 0;
-    mtx_unlock(&_mtxQ);
+    if (_nInjected.load(std::memory_order_relaxed) > 0)
+        return true;
 
-    return ret;
+    for (u32 i = 0; i < _threadCount; i++)
+        if (!_pWorkers[i].q.empty()) return true;
+
+    return false;
 }
 
-inline int
-ThreadPool::loop(void* p)
+inline void
+ThreadPool::run(TaskNode task)
 {
-    auto* self = (ThreadPool*)p;
+    task.pfn(task.pArgs);
 
-    while (!self->_bDone)
+    /* the group may be gone as soon as it reaches zero */
+    if (task.pGroup)
+        task.pGroup->_nPending.fetch_sub(1, std::memory_order_release);
+
+    if (_nPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
     {
-        TaskNode task;
-        {
-            mtx_lock(&self->_mtxQ);
+        /* under `_mtxWait`, so the signal can't slip between `wait()`'s check and its sleep */
+        mtx_lock(&_mtxWait);
+        cnd_broadcast(&_cndWait);
+        mtx_unlock(&_mtxWait);
+    }
+}
+
+/* Pairs with `park()`: either the parking worker sees the new task or we see it counted in `_nSleeping`.
+ * It holds `_mtxSleep` from the count until it sleeps, so the signal can't come too early. */
+inline void
+ThreadPool::wake()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_nSleeping.load(std::memory_order_relaxed) > 0)
+    {
+        mtx_lock(&_mtxSleep);
+        cnd_signal(&_cndSleep);
+        mtx_unlock(&_mtxSleep);
+    }
+}
 
-            while (!(!self->_qTasks.empty() || self->_bDone))
-                cnd_wait(&self->_cndQ, &self->_mtxQ);
+inline void
+ThreadPool::park()
+{
+    mtx_lock(&_mtxSleep);
+    _nSleeping.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
-            if (self->_bDone)
-            {
-                mtx_unlock(&self->_mtxQ);
-                return thrd_success;
-            }
+    if (!_bDone.load(std::memory_order_relaxed) && !hasWork())
+        cnd_wait(&_cndSleep, &_mtxSleep);
 
-            task = *self->_qTasks.popFront();
-            self->_activeTaskCount++; /* increment before unlocking mtxQ to avoid 0 tasks and 0 q possibility */
+    _nSleeping.fetch_sub(1, std::memory_order_relaxed);
+    mtx_unlock(&_mtxSleep);
+}
 
-            mtx_unlock(&self->_mtxQ);
-        }
+inline int
+ThreadPool::loop(void* p)
+{
+    auto* pW = (ThreadPoolWorker*)p;
+    auto* self = pW->pPool;
 
-        task.pfn(task.pArgs);
-        self->_activeTaskCount--;
+    g_tThreadPoolWorker = pW;
+    g_tThreadPoolRng ^= (pW->idx + 1) * 0xBF58476D1CE4E5B9;
 
-        if (!self->busy())
-            cnd_signal(&self->_cndWait);
+    u32 nIdle = 0;
+    while (!self->_bDone.load(std::memory_order_relaxed))
+    {
+        TaskNode task;
+        if (self->findTask(pW, &task))
+        {
+            self->run(task);
+            nIdle = 0;
+        }
+        else if (++nIdle < THREAD_POOL_SPIN_ROUNDS)
+        {
+            if (nIdle < THREAD_POOL_SPIN_ROUNDS / 2)
+                for (int i = 0; i < 32; i++) cpuRelax();
+            else thrd_yield();
+        }
+        else
+        {
+            self->park();
+            nIdle = 0;
+        }
     }
 
+    g_tThreadPoolWorker = nullptr;
+
     return thrd_success;
 }
 
 inline void
 ThreadPool::submit(TaskNode task)
 {
-    mtx_lock(&_mtxQ);
-    _qTasks.pushBack(task);
-    mtx_unlock(&_mtxQ);
+    _nPending.fetch_add(1, std::memory_order_relaxed);
+    if (task.pGroup)
+        task.pGroup->_nPending.fetch_add(1, std::memory_order_relaxed);
+
+    ThreadPoolWorker* pW = g_tThreadPoolWorker;
+    if (!pW || pW->pPool != this || !pW->q.push(task))
+    {
+        mtx_lock(&_mtxQ);
+        _qTasks.pushBack(task);
+        _nInjected.fetch_add(1, std::memory_order_release);
+        mtx_unlock(&_mtxQ);
+    }
 
-    cnd_signal(&_cndQ);
+    wake();
 }
 
 inline void
 ThreadPool::wait()
 {
+    mtx_lock(&_mtxWait);
     while (busy())
-    {
-        mtx_lock(&_mtxWait);
         cnd_wait(&_cndWait, &_mtxWait);
-        mtx_unlock(&_mtxWait);
+    mtx_unlock(&_mtxWait);
+}
+
+inline bool
+ThreadPool::runOne()
+{
+    ThreadPoolWorker* pW = g_tThreadPoolWorker;
+    if (pW && pW->pPool != this) pW = nullptr;
+
+    TaskNode task;
+    if (!findTask(pW, &task))
+        return false;
+
+    run(task);
+    return true;
+}
+
+/* Waiting on tasks from inside a task can't deadlock: the waiter keeps running whatever is queued,
+ * including the tasks it waits for. */
+inline void
+ThreadPool::helpWhile(const std::atomic<u32>* pCount)
+{
+    u32 nIdle = 0;
+    while (pCount->load(std::memory_order_acquire) > 0)
+    {
+        if (runOne()) nIdle = 0;
+        else if (++nIdle < THREAD_POOL_SPIN_ROUNDS) cpuRelax();
+        else thrd_yield();
     }
 }
 
+inline bool
+ThreadPool::localEmpty()
+{
+    ThreadPoolWorker* pW = g_tThreadPoolWorker;
+    if (pW && pW->pPool == this)
+        return pW->q.empty();
+
+    return _nInjected.load(std::memory_order_relaxed) == 0;
+}
+
 inline void
 ThreadPool::stop()
 {
-    _bDone = true;
-    cnd_broadcast(&_cndQ);
+    mtx_lock(&_mtxSleep);
+    _bDone.store(true, std::memory_order_relaxed);
+    cnd_broadcast(&_cndSleep);
+    mtx_unlock(&_mtxSleep);
+
     for (u32 i = 0; i < _threadCount; i++)
         thrd_join(_pThreads[i], nullptr);
 }
@@ -164,12 +445,70 @@ ThreadPool::destroy()
 {
     stop();
 
+    for (u32 i = 0; i < _threadCount; i++)
+        _pAlloc->free(_pWorkers[i].q._pSlots);
+    ::free(_pWorkers);
     _pAlloc->free(_pThreads);
     _qTasks.destroy();
-    cnd_destroy(&_cndQ);
-    mtx_destroy(&_mtxQ);
+    cnd_destroy(&_cndSleep);
+    mtx_destroy(&_mtxSleep);
     cnd_destroy(&_cndWait);
     mtx_destroy(&_mtxWait);
+    mtx_destroy(&_mtxQ);
+}
+
+/* Result of `async()`. `T` must be default constructible. */
+template<typename T>
+struct Future
+{
+    Allocator* _pAlloc {};
+    TaskGroup _group {};
+    T _val {};
+
+    bool ready() const { return _group.done(); }
+    T& get(ThreadPool* pPool) { pPool->waitFor(&_group); return _val; } /* helps `pPool` until ready */
+    void destroy(); /* after it's ready */
+};
+
+template<typename T>
+inline void
+Future<T>::destroy()
+{
+    assert(ready());
+    Allocator* pAlloc = _pAlloc;
+    this->~Future();
+    pAlloc->free(this);
+}
+
+/* future and the callable in one allocation, callable is destroyed as soon as it's done */
+template<typename T, typename F>
+struct FutureTask : Future<T>
+{
+    F f;
+
+    static int
+    run(void* pArg)
+    {
+        auto* self = (FutureTask*)pArg;
+        self->_val = self->f();
+        self->f.~F();
+
+        return 0;
+    }
+};
+
+/* Runs `f()` on `pPool`, result goes to a `Future` allocated from `pAlloc`, free it with `Future::destroy()` */
+template<typename F>
+inline Future<decltype(std::declval<F&>()())>*
+async(ThreadPool* pPool, Allocator* pAlloc, F f)
+{
+    using T = decltype(f());
+
+    auto* pTask = (FutureTask<T, F>*)pAlloc->alloc(1, sizeof(FutureTask<T, F>));
+    new(pTask) FutureTask<T, F> {{pAlloc}, static_cast<F&&>(f)};
+    pPool->submit(&pTask->_group, FutureTask<T, F>::run, pTask);
+
+    return pTask;
 }
 
 } /* namespace adt */
@@ -2,12 +2,44 @@
 
 #include "String.hh"
 #include "Array.hh"
+#include "DefaultAllocator.hh"
+#include "logs.hh"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <limits.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 namespace adt
 {
 
+enum MAPPED : u32
+{
+    MAPPED_DEFAULT = 0,
+    MAPPED_SEQUENTIAL = 1,    /* MADV_SEQUENTIAL: aggressive readahead, drop pages behind */
+    MAPPED_POPULATE = 1 << 1, /* MAP_POPULATE: prefault the whole file up front */
+};
+
+/* zeroed bytes guaranteed after the end of a mapping, safe for block-wise over-reads */
+constexpr u32 MAPPED_PADDING = 64;
+
+struct MappedFile
+{
+    String sFile; /* points into the mapping, `sFile[sFile._size]` is '\0' */
+    void* pMap = nullptr;
+    size_t mapSize = 0;
+};
+
+/* `padding` zeroed bytes follow the contents, at least 1 for '\0' */
 inline String
-loadFile(Allocator* pAlloc, String path)
+loadFile(Allocator* pAlloc, String path, u32 padding = 1)
 {
     String ret;
 
@@ -17,11 +49,19 @@ loadFile(Allocator* pAlloc, String path)
     if (pf)
     {
         fseek(pf, 0, SEEK_END);
-        long size = ftell(pf) + 1;
+        long size = ftell(pf);
         rewind(pf);
 
-        ret._pData = (char*)(pAlloc->alloc(size, sizeof(char)));
-        ret._size = size - 1;
+        if (size < 0 || u64(size) > UINT32_MAX - padding)
+        {
+            CERR("loadFile: '%.*s' is %ld bytes, max is %u\n", path._size, path._pData, size, UINT32_MAX - padding);
+            fclose(pf);
+            errno = EFBIG;
+            return ret;
+        }
+
+        ret._pData = (char*)(pAlloc->alloc(size + padding, sizeof(char)));
+        ret._size = size;
         fread(ret._pData, 1, ret._size, pf);
 
         fclose(pf);
@@ -30,6 +70,89 @@ loadFile(Allocator* pAlloc, String path)
     return ret;
 }
 
+/* Read-only private mapping of the whole file followed by at least `MAPPED_PADDING` zeroed bytes.
+ * Returns empty `sFile` on failure, falls back to `loadFile()` where mmap isn't available.
+ * `String` sizes are u32, bigger files are rejected with errno EFBIG. */
+inline MappedFile
+mapFile(String path, u32 eFlags)
+{
+    MappedFile ret {};
+
+#ifdef __linux__
+    char aPath[PATH_MAX] {};
+    if (path._size >= sizeof(aPath)) return ret;
+    memcpy(aPath, path._pData, path._size);
+
+    int fd = open(aPath, O_RDONLY);
+    if (fd == -1) return ret;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
+    {
+        close(fd);
+        return ret;
+    }
+
+    if (u64(st.st_size) > UINT32_MAX - MAPPED_PADDING)
+    {
+        CERR("mapFile: '%.*s' is %lld bytes, max is %u\n", path._size, path._pData, (long long)st.st_size, UINT32_MAX - MAPPED_PADDING);
+        close(fd);
+        errno = EFBIG;
+        return ret;
+    }
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t mapSize = ((st.st_size + MAPPED_PADDING) + pageSize - 1) & ~(pageSize - 1);
+
+    /* reserve file + padding with zero pages, then put the file over the front of it */
+    u8* pRes = (u8*)mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pRes == MAP_FAILED)
+    {
+        close(fd);
+        return ret;
+    }
+
+    int mapFlags = MAP_PRIVATE | MAP_FIXED;
+    if (eFlags & MAPPED_POPULATE) mapFlags |= MAP_POPULATE;
+
+    void* pFile = mmap(pRes, st.st_size, PROT_READ, mapFlags, fd, 0);
+    close(fd);
+
+    if (pFile == MAP_FAILED)
+    {
+        munmap(pRes, mapSize);
+        return ret;
+    }
+
+    if (eFlags & MAPPED_SEQUENTIAL)
+        madvise(pRes, st.st_size, MADV_SEQUENTIAL);
+
+    ret.sFile = {(char*)pRes, u32(st.st_size)};
+    ret.pMap = pRes;
+    ret.mapSize = mapSize;
+#else
+    (void)eFlags;
+    ret.sFile = loadFile(&StdAllocator, path, MAPPED_PADDING);
+    ret.pMap = ret.sFile._pData;
+#endif
+
+    return ret;
+}
+
+inline void
+unmapFile(MappedFile* pMapped)
+{
+    if (!pMapped->pMap) return;
+
+#ifdef __linux__
+    munmap(pMapped->pMap, pMapped->mapSize);
+#else
+    StdAllocator.free(pMapped->pMap);
+#endif
+
+    *pMapped = {};
+}
+
 inline Array<u8>
 loadFileToCharArray(Allocator* pAlloc, String path)
 {
@@ -1,31 +1,133 @@
 #pragma once
 
+#include <string.h>
+#include <type_traits>
+
 #include "ultratypes.h"
 
 namespace adt
 {
 
-template<typename T>
-inline u64
-fnHash(T& x)
+/* wyhash (final version 4.2, public domain) secrets */
+constexpr u64 HASH_WY_SECRET[4] {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+constexpr u64
+hashWYMix(u64 a, u64 b)
 {
-    return (x);
+    __uint128_t r = __uint128_t(a) * b;
+    return u64(r) ^ u64(r >> 64);
 }
 
-template<>
+/* little endian loads, byte by byte when evaluated at compile time */
+constexpr u64
+hashWYRead8(const char* p)
+{
+    if (std::is_constant_evaluated())
+    {
+        u64 r = 0;
+        for (int i = 7; i >= 0; i--) r = (r << 8) | u8(p[i]);
+        return r;
+    }
+
+    u64 r;
+    memcpy(&r, p, 8);
+    return r;
+}
+
+constexpr u64
+hashWYRead4(const char* p)
+{
+    if (std::is_constant_evaluated())
+    {
+        u64 r = 0;
+        for (int i = 3; i >= 0; i--) r = (r << 8) | u8(p[i]);
+        return r;
+    }
+
+    u32 r;
+    memcpy(&r, p, 4);
+    return r;
+}
+
+/* wyhash: 16 bytes per step up to 48, 48 bytes per step (3 lanes) after that.
+ * Usable in constant expressions, same result either way. */
+constexpr u64
+hashWY(const char* str, u32 size, u64 seed = 0)
+{
+    const u64* s = HASH_WY_SECRET;
+    const char* p = str;
+    u64 a = 0, b = 0;
+
+    seed ^= hashWYMix(seed ^ s[0], s[1]);
+
+    if (size <= 16)
+    {
+        if (size >= 4)
+        {
+            a = (hashWYRead4(p) << 32) | hashWYRead4(p + ((size >> 3) << 2));
+            b = (hashWYRead4(p + size - 4) << 32) | hashWYRead4(p + size - 4 - ((size >> 3) << 2));
+        }
+        else if (size > 0)
+        {
+            a = (u64(u8(p[0])) << 16) | (u64(u8(p[size >> 1])) << 8) | u64(u8(p[size - 1]));
+        }
+    }
+    else
+    {
+        u32 i = size;
+
+        if (i >= 48)
+        {
+            u64 see1 = seed, see2 = seed;
+            do
+            {
+                seed = hashWYMix(hashWYRead8(p) ^ s[1], hashWYRead8(p + 8) ^ seed);
+                see1 = hashWYMix(hashWYRead8(p + 16) ^ s[2], hashWYRead8(p + 24) ^ see1);
+                see2 = hashWYMix(hashWYRead8(p + 32) ^ s[3], hashWYRead8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            }
+            while (i >= 48);
+
+            seed ^= see1 ^ see2;
+        }
+
+        while (i > 16)
+        {
+            seed = hashWYMix(hashWYRead8(p) ^ s[1], hashWYRead8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+
+        a = hashWYRead8(p + i - 16);
+        b = hashWYRead8(p + i - 8);
+    }
+
+    a ^= s[1];
+    b ^= seed;
+    __uint128_t r = __uint128_t(a) * b;
+    a = u64(r);
+    b = u64(r >> 64);
+
+    return hashWYMix(a ^ s[0] ^ size, b ^ s[1]);
+}
+
+/* integers and pointers are mixed, identity hashes cluster in power of two tables */
+template<typename T>
 inline u64
-fnHash<u64>(u64& x)
+fnHash(T& x)
 {
-    return x;
+    return hashWYMix(u64(x) ^ HASH_WY_SECRET[0], HASH_WY_SECRET[1]);
 }
 
 template<>
 inline u64
 fnHash<void* const>(void* const& x)
 {
-    return reinterpret_cast<u64>(x);
+    return hashWYMix(reinterpret_cast<u64>(x) ^ HASH_WY_SECRET[0], HASH_WY_SECRET[1]);
 }
 
+/* byte at a time, kept for stable on-disk hashes */
 constexpr u64
 hashFNV(const char* str, u32 size)
 {
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "ThreadPool.hh"
+
+namespace adt
+{
+
+constexpr u32 PARALLEL_MAX_SPLITS = 32; /* u32 range can't be halved more times than that */
+constexpr u32 PARALLEL_GRAINS_PER_THREAD = 8; /* default grain, when 0 is passed */
+
+template<typename T, typename MAP, typename REDUCE>
+struct ParallelCtx
+{
+    ThreadPool* pPool;
+    const MAP* pMap;
+    const REDUCE* pReduce;
+    const T* pIdentity;
+    u32 grain;
+};
+
+/* right half split off as a task, lives on the splitting frame's stack */
+template<typename T, typename MAP, typename REDUCE>
+struct ParallelSplit
+{
+    ParallelCtx<T, MAP, REDUCE>* pCtx;
+    u32 begin;
+    u32 end;
+    T result;
+    TaskGroup group; /* just this task */
+};
+
+template<typename T, typename MAP, typename REDUCE>
+inline T parallelReduceRange(ParallelCtx<T, MAP, REDUCE>* pCtx, u32 begin, u32 end);
+
+template<typename T, typename MAP, typename REDUCE>
+inline int
+parallelReduceTask(void* pArg)
+{
+    auto* pS = (ParallelSplit<T, MAP, REDUCE>*)pArg;
+    pS->result = parallelReduceRange(pS->pCtx, pS->begin, pS->end);
+
+    return 0;
+}
+
+/* Lazy binary splitting: the right half is split off only while nothing is queued locally, that is when some
+ * worker is probably idle and can steal it, otherwise the next grain is done in place. So the range is cut as
+ * much as the pool can take at the moment and no more. Splits are folded right to left after helping them
+ * finish, `reduce` only needs to be associative. */
+template<typename T, typename MAP, typename REDUCE>
+inline T
+parallelReduceRange(ParallelCtx<T, MAP, REDUCE>* pCtx, u32 begin, u32 end)
+{
+    ParallelSplit<T, MAP, REDUCE> aSplits[PARALLEL_MAX_SPLITS];
+    u32 nSplits = 0;
+    T acc = *pCtx->pIdentity;
+
+    while (begin < end)
+    {
+        if (end - begin > pCtx->grain && nSplits < PARALLEL_MAX_SPLITS && pCtx->pPool->localEmpty())
+        {
+            u32 mid = begin + (end - begin) / 2;
+            auto& s = aSplits[nSplits++];
+            s.pCtx = pCtx;
+            s.begin = mid;
+            s.end = end;
+            pCtx->pPool->submit(&s.group, parallelReduceTask<T, MAP, REDUCE>, &s);
+            end = mid;
+            continue;
+        }
+
+        u32 grainEnd = end - begin > pCtx->grain ? begin + pCtx->grain : end;
+        for (; begin < grainEnd; begin++)
+            acc = (*pCtx->pReduce)(acc, (*pCtx->pMap)(begin));
+    }
+
+    for (u32 i = nSplits; i-- > 0; )
+    {
+        pCtx->pPool->waitFor(&aSplits[i].group);
+        acc = (*pCtx->pReduce)(acc, aSplits[i].result);
+    }
+
+    return acc;
+}
+
+/* `reduce(identity, map(i))` folded over [begin, end) on `pPool`, in order. Blocks until done, running pool tasks
+ * meanwhile, so it can be called from inside other tasks. `grain` is the smallest run of indices done in one go,
+ * 0 picks one. `T` must be default constructible. Null `pPool` runs on the caller. */
+template<typename T, typename MAP, typename REDUCE>
+inline T
+parallelReduce(ThreadPool* pPool, u32 begin, u32 end, u32 grain, const T& identity, const MAP& map, const REDUCE& reduce)
+{
+    if (begin >= end)
+        return identity;
+
+    if (!pPool)
+    {
+        T acc = identity;
+        for (u32 i = begin; i < end; i++) acc = reduce(acc, map(i));
+        return acc;
+    }
+
+    if (grain == 0)
+    {
+        grain = (end - begin) / (pPool->_threadCount * PARALLEL_GRAINS_PER_THREAD);
+        if (grain == 0) grain = 1;
+    }
+
+    ParallelCtx<T, MAP, REDUCE> ctx {pPool, &map, &reduce, &identity, grain};
+    return parallelReduceRange(&ctx, begin, end);
+}
+
+/* `f(i)` for each i in [begin, end) on `pPool`, same rules as `parallelReduce()` */
+template<typename F>
+inline void
+parallelFor(ThreadPool* pPool, u32 begin, u32 end, u32 grain, const F& f)
+{
+    auto map = [&f](u32 i) { f(i); return 0; };
+    auto reduce = [](int, int) { return 0; };
+    parallelReduce(pPool, begin, end, grain, 0, map, reduce);
+}
+
+} /* namespace adt */
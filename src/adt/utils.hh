@@ -80,4 +80,15 @@ timeNowS()
     return timeNowMS() / 1000.0;
 }
 
+/* spin-wait hint */
+inline void
+cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
 } /* namespace adt */
@@ -14,11 +14,12 @@ enum class TAG
     DOUBLE,
     ARRAY,
     OBJECT,
-    BOOL
+    BOOL,
+    INVALID /* never in the DOM, `Cursor::getTag()` of a missing value or malformed literal */
 };
 
 static const char* TAGStrings[] {
-    "NULL_", "STRING", "LONG", "DOUBLE", "ARRAY", "OBJECT", "BOOL"
+    "NULL_", "STRING", "LONG", "DOUBLE", "ARRAY", "OBJECT", "BOOL", "INVALID"
 };
 
 inline const char*
@@ -29,6 +30,14 @@ getTAGString(enum TAG t)
 
 struct Object;
 
+/* which strings of a node are exactly as in the source, escapes included */
+enum RAW : u8
+{
+    RAW_NONE = 0,
+    RAW_KEY = 1,
+    RAW_STRING = 1 << 1,
+};
+
 union Val
 {
     void* n;
@@ -43,6 +52,7 @@ union Val
 struct TagVal
 {
     enum TAG tag;
+    u8 eRaw = RAW_NONE; /* `RAW` flags, parser strings are raw, `put*()` strings are plain text */
     union Val val;
 };
 
@@ -0,0 +1,246 @@
+#include <string.h>
+
+#if defined __AVX2__ || defined __SSE2__
+    #include <immintrin.h>
+#endif
+
+#include "index.hh"
+#include "logs.hh"
+
+namespace json
+{
+
+constexpr u32 BLOCK_SIZE = 64;
+constexpr u64 ODD_BITS = 0xAAAAAAAAAAAAAAAAULL;
+
+/* one bit per byte of the block */
+struct BlockMasks
+{
+    u64 backslash;
+    u64 quote;
+    u64 whiteSpace;
+    u64 op;
+};
+
+#if defined __AVX2__
+
+static inline u64
+eq(__m256i lo, __m256i hi, char c)
+{
+    __m256i vc = _mm256_set1_epi8(c);
+    u64 l = u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vc)));
+    u64 h = u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vc)));
+    return l | (h << 32);
+}
+
+static inline BlockMasks
+classify(const char* p)
+{
+    __m256i lo = _mm256_loadu_si256((const __m256i*)(p));
+    __m256i hi = _mm256_loadu_si256((const __m256i*)(p + 32));
+
+    return {
+        .backslash = eq(lo, hi, '\\'),
+        .quote = eq(lo, hi, '"'),
+        .whiteSpace = eq(lo, hi, ' ') | eq(lo, hi, '\t') | eq(lo, hi, '\n') | eq(lo, hi, '\r'),
+        .op = eq(lo, hi, '{') | eq(lo, hi, '}') | eq(lo, hi, '[') | eq(lo, hi, ']') | eq(lo, hi, ':') | eq(lo, hi, ',')
+    };
+}
+
+#elif defined __SSE2__
+
+static inline u64
+eq(const __m128i* aV, char c)
+{
+    __m128i vc = _mm_set1_epi8(c);
+    u64 r = 0;
+    for (u32 i = 0; i < 4; i++)
+        r |= u64(u16(_mm_movemask_epi8(_mm_cmpeq_epi8(aV[i], vc)))) << (i * 16);
+
+    return r;
+}
+
+static inline BlockMasks
+classify(const char* p)
+{
+    __m128i aV[4];
+    for (u32 i = 0; i < 4; i++)
+        aV[i] = _mm_loadu_si128((const __m128i*)(p + i * 16));
+
+    return {
+        .backslash = eq(aV, '\\'),
+        .quote = eq(aV, '"'),
+        .whiteSpace = eq(aV, ' ') | eq(aV, '\t') | eq(aV, '\n') | eq(aV, '\r'),
+        .op = eq(aV, '{') | eq(aV, '}') | eq(aV, '[') | eq(aV, ']') | eq(aV, ':') | eq(aV, ',')
+    };
+}
+
+#else
+
+static inline BlockMasks
+classify(const char* p)
+{
+    BlockMasks m {};
+    for (u32 i = 0; i < BLOCK_SIZE; i++)
+    {
+        u64 bit = 1ULL << i;
+        switch (p[i])
+        {
+            default: break;
+
+            case '\\': m.backslash |= bit; break;
+            case '"': m.quote |= bit; break;
+
+            case ' ': case '\t': case '\n': case '\r':
+                m.whiteSpace |= bit;
+                break;
+
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                m.op |= bit;
+                break;
+        }
+    }
+
+    return m;
+}
+
+#endif
+
+/* bit i of the result is the xor of bits [0..i] of m */
+static inline u64
+prefixXor(u64 m)
+{
+#if defined __PCLMUL__
+    __m128i r = _mm_clmulepi64_si128(_mm_set_epi64x(0, m), _mm_set1_epi8(-1), 0);
+    return u64(_mm_cvtsi128_si64(r));
+#else
+    m ^= m << 1;
+    m ^= m << 2;
+    m ^= m << 4;
+    m ^= m << 8;
+    m ^= m << 16;
+    m ^= m << 32;
+    return m;
+#endif
+}
+
+/* Bytes preceded by an odd run of backslashes.
+ * `nextIsEscaped` carries the escape of the first byte over from the previous block. */
+static inline u64
+escapedMask(u64 backslash, u64& nextIsEscaped)
+{
+    if (!backslash)
+    {
+        u64 r = nextIsEscaped;
+        nextIsEscaped = 0;
+        return r;
+    }
+
+    /* escaped backslash can't start an escape */
+    u64 potential = backslash & ~nextIsEscaped;
+    u64 maybeEscaped = potential << 1;
+    /* subtraction flips parity at the end of each run, which leaves even/odd code bits */
+    u64 escapeAndTerminal = ((maybeEscaped | ODD_BITS) - potential) ^ ODD_BITS;
+    u64 escaped = escapeAndTerminal ^ (backslash | nextIsEscaped);
+    u64 escape = escapeAndTerminal & backslash;
+    nextIsEscaped = escape >> 63;
+
+    return escaped;
+}
+
+adt::Array<u32>
+buildIndex(adt::Allocator* pAlloc, adt::String sFile)
+{
+    adt::Array<u32> aIdx(pAlloc, sFile._size / 8 + BLOCK_SIZE);
+
+    u64 nextIsEscaped = 0;
+    u64 prevInString = 0;
+    u64 prevScalar = 0;
+
+    for (u32 base = 0; base < sFile._size; base += BLOCK_SIZE)
+    {
+        const char* p = &sFile[base];
+        char aTail[BLOCK_SIZE];
+
+        /* pad the last block with spaces instead of reading past the end */
+        if (sFile._size - base < BLOCK_SIZE)
+        {
+            memset(aTail, ' ', sizeof(aTail));
+            memcpy(aTail, p, sFile._size - base);
+            p = aTail;
+        }
+
+        BlockMasks m = classify(p);
+
+        u64 quote = m.quote & ~escapedMask(m.backslash, nextIsEscaped);
+        /* covers opening quote and string body, not the closing quote */
+        u64 inString = prefixXor(quote) ^ prevInString;
+        prevInString = u64(s64(inString) >> 63);
+
+        u64 scalar = ~(m.whiteSpace | m.op | quote) & ~inString;
+        u64 scalarStart = scalar & ~((scalar << 1) | prevScalar);
+        prevScalar = scalar >> 63;
+
+        u64 structurals = (m.op & ~inString) | quote | scalarStart;
+
+        if (aIdx._size + BLOCK_SIZE > aIdx._capacity)
+            aIdx.grow(aIdx._capacity * 2);
+
+        u32* pOut = &aIdx[aIdx._size];
+        u32 n = 0;
+        while (structurals)
+        {
+            pOut[n++] = base + __builtin_ctzll(structurals);
+            structurals &= structurals - 1;
+        }
+        aIdx._size += n;
+    }
+
+    if (prevInString)
+    {
+        CERR("unterminated string\n");
+        exit(1);
+    }
+
+    return aIdx;
+}
+
+adt::Array<u32>
+countElements(adt::Allocator* pAlloc, adt::String sFile, const adt::Array<u32>& aIdx)
+{
+    adt::Array<u32> aCounts(pAlloc, aIdx._size / 8 + adt::SIZE_MIN);
+    adt::Array<u32> aOpen(pAlloc, 64); /* counts of the containers that are still open */
+
+    for (u32 i = 0; i < aIdx._size; i++)
+    {
+        switch (sFile[aIdx[i]])
+        {
+            default:
+                break;
+
+            case '{':
+            case '[':
+                {
+                    char next = i + 1 < aIdx._size ? sFile[aIdx[i + 1]] : '\0';
+                    aOpen.push(aCounts._size);
+                    aCounts.push(next == '}' || next == ']' ? 0 : 1);
+                }
+                break;
+
+            case ',':
+                if (!aOpen.empty()) aCounts[aOpen.back()]++;
+                break;
+
+            case '}':
+            case ']':
+                if (!aOpen.empty()) aOpen.pop();
+                break;
+        }
+    }
+
+    aOpen.destroy();
+
+    return aCounts;
+}
+
+} /* namespace json */
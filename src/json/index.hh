@@ -0,0 +1,19 @@
+#pragma once
+
+#include "String.hh"
+#include "Array.hh"
+
+namespace json
+{
+
+/* Stage-1 structural index.
+ * Scans the file in 64 byte blocks and records the position of every token start:
+ * operators `{}[]:,` outside of strings, both quotes of every string and the first byte of each bare scalar
+ * (numbers, true, false, null). Exits on unterminated string, like the lexer does. */
+adt::Array<u32> buildIndex(adt::Allocator* pAlloc, adt::String sFile);
+
+/* Member count of every object and array in the order they open, one pass over the structural index.
+ * Lets the parser allocate containers at their exact size. Counts of malformed input are only a hint. */
+adt::Array<u32> countElements(adt::Allocator* pAlloc, adt::String sFile, const adt::Array<u32>& aIdx);
+
+} /* namespace json */
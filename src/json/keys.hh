@@ -0,0 +1,167 @@
+#pragma once
+
+#include <string.h>
+
+#include "ast.hh"
+#include "hash.hh"
+#include "HashMap.hh"
+
+namespace json
+{
+
+/* objects with fewer members are searched linearly */
+constexpr u32 KEY_INDEX_THRESHOLD = 16;
+
+/* Open addressing table over members of one object, allocated from the object's allocator.
+ * Slot holds member index + 1 (0 is empty) and the low 32 bits of its key hash. */
+struct KeyIndex
+{
+    u32* pSlots;
+    u32* pHashes;
+    u32 capacity; /* power of 2 */
+    u32 nIndexed; /* members [0, nIndexed) are in the table */
+};
+
+inline u32
+keyHash(adt::String svKey)
+{
+    return u32(adt::hashWY(svKey._pData, svKey._size));
+}
+
+inline KeyIndex*
+makeKeyIndex(adt::Allocator* pAlloc, u32 nMembers)
+{
+    u32 cap = 32;
+    while (cap < nMembers * 2) cap *= 2;
+
+    auto* pIdx = (KeyIndex*)pAlloc->alloc(1, sizeof(KeyIndex));
+    pIdx->pSlots = (u32*)pAlloc->alloc(cap, sizeof(u32));
+    pIdx->pHashes = (u32*)pAlloc->alloc(cap, sizeof(u32));
+    memset(pIdx->pSlots, 0, cap * sizeof(u32));
+    pIdx->capacity = cap;
+    pIdx->nIndexed = 0;
+
+    return pIdx;
+}
+
+inline void
+freeKeyIndex(adt::Allocator* pAlloc, KeyIndex* pIdx)
+{
+    pAlloc->free(pIdx->pSlots);
+    pAlloc->free(pIdx->pHashes);
+    pAlloc->free(pIdx);
+}
+
+/* member index of the first `svKey`, NPOS if not in the table */
+inline u32
+keyIndexFind(const KeyIndex* pIdx, const adt::Array<Object>& aObj, adt::String svKey, u32 hash)
+{
+    u32 mask = pIdx->capacity - 1;
+
+    for (u32 i = hash & mask; pIdx->pSlots[i]; i = (i + 1) & mask)
+    {
+        u32 m = pIdx->pSlots[i] - 1;
+        if (pIdx->pHashes[i] == hash && m < aObj._size && aObj[m].svKey == svKey)
+            return m;
+    }
+
+    return adt::NPOS;
+}
+
+/* Index members added since the last call, keeps the first of duplicate keys like linear search does.
+ * Fewer members than indexed means some were removed, the table is rebuilt from scratch. */
+inline void
+keyIndexUpdate(adt::Allocator* pAlloc, KeyIndex* pIdx, const adt::Array<Object>& aObj)
+{
+    if (aObj._size < pIdx->nIndexed)
+    {
+        memset(pIdx->pSlots, 0, pIdx->capacity * sizeof(u32));
+        pIdx->nIndexed = 0;
+    }
+
+    if (aObj._size * 2 > pIdx->capacity)
+    {
+        KeyIndex* pNew = makeKeyIndex(pAlloc, aObj._size);
+        pAlloc->free(pIdx->pSlots);
+        pAlloc->free(pIdx->pHashes);
+        *pIdx = *pNew;
+        pAlloc->free(pNew);
+    }
+
+    u32 mask = pIdx->capacity - 1;
+
+    for (u32 m = pIdx->nIndexed; m < aObj._size; m++)
+    {
+        u32 hash = keyHash(aObj[m].svKey);
+        if (keyIndexFind(pIdx, aObj, aObj[m].svKey, hash) != adt::NPOS)
+            continue;
+
+        u32 i = hash & mask;
+        while (pIdx->pSlots[i]) i = (i + 1) & mask;
+
+        pIdx->pSlots[i] = m + 1;
+        pIdx->pHashes[i] = hash;
+    }
+
+    pIdx->nIndexed = aObj._size;
+}
+
+/* Key indexes of big objects, kept out of the DOM so nodes stay small and searches never write to it.
+ * Entries are keyed by the object's member buffer: pushed members are indexed on the next lookup, fewer members
+ * than indexed rebuild the index, a reallocated buffer gets a new entry. Keys changed in place or a buffer freed
+ * and reused by another object can leave an entry stale, `searchObject()` confirms every miss linearly and
+ * drops such entries, so lookups stay correct and only get slower until the next one.
+ * A table is not thread-safe. Threads can search one DOM concurrently with a table each. */
+struct KeyIndexTable
+{
+    adt::Allocator* _pAlloc {};
+    adt::Map<const Object*, KeyIndex*> _map;
+
+    KeyIndexTable() = default;
+    KeyIndexTable(adt::Allocator* p) : _pAlloc(p), _map(p) {}
+
+    KeyIndex* get(const adt::Array<Object>& aObj); /* up to date index for `aObj` */
+    void invalidate(const adt::Array<Object>& aObj);
+    void clear();
+    void destroy() { clear(); _map.destroy(); }
+};
+
+inline KeyIndex*
+KeyIndexTable::get(const adt::Array<Object>& aObj)
+{
+    auto ret = _map.search(aObj._pData);
+    KeyIndex* pIdx = ret.pData ? ret.pData->val : nullptr;
+
+    if (!pIdx)
+    {
+        pIdx = makeKeyIndex(_pAlloc, aObj._size);
+        _map.insert(aObj._pData, pIdx);
+    }
+
+    if (pIdx->nIndexed != aObj._size)
+        keyIndexUpdate(_pAlloc, pIdx, aObj);
+
+    return pIdx;
+}
+
+inline void
+KeyIndexTable::invalidate(const adt::Array<Object>& aObj)
+{
+    auto ret = _map.search(aObj._pData);
+    if (!ret.pData) return;
+
+    freeKeyIndex(_pAlloc, ret.pData->val);
+    _map.remove(ret.idx);
+}
+
+inline void
+KeyIndexTable::clear()
+{
+    for (auto& e : _map)
+        freeKeyIndex(_pAlloc, e.val);
+
+    _map.destroy();
+    _map = adt::Map<const Object*, KeyIndex*>(_pAlloc);
+}
+
+} /* namespace json */
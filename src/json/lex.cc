@@ -1,7 +1,7 @@
 #include <ctype.h>
 
 #include "lex.hh"
-#include "file.hh"
+#include "index.hh"
 #include "logs.hh"
 
 namespace json
@@ -10,7 +10,35 @@ namespace json
 void
 Lexer::loadFile(adt::String path)
 {
-    _sFile = adt::loadFile(_pArena, path);
+    _mapped = adt::mapFile(path, adt::MAPPED_SEQUENTIAL | adt::MAPPED_POPULATE);
+    _sFile = _mapped.sFile;
+    _aIdx = buildIndex(_pArena, _sFile);
+    _idxI = 0;
+}
+
+void
+Lexer::loadString(adt::String sData)
+{
+    _mapped = {};
+    _sFile = sData;
+    _aIdx = buildIndex(_pArena, _sFile);
+    _idxI = 0;
+}
+
+void
+Lexer::loadIndexed(adt::MappedFile mapped, adt::Array<u32> aIdx)
+{
+    _mapped = mapped;
+    _sFile = _mapped.sFile;
+    _aIdx = aIdx;
+    _idxI = 0;
+}
+
+void
+Lexer::destroy()
+{
+    adt::unmapFile(&_mapped);
+    _sFile = {};
 }
 
 void
@@ -126,6 +154,20 @@ done:
     return r;
 }
 
+Token
+Lexer::indexedString()
+{
+    /* closing quote is the next entry */
+    u32 start = _pos;
+    u32 end = _aIdx[_idxI++];
+    _pos = end;
+
+    return {
+        .type = Token::IDENT,
+        .svLiteral = {&_sFile[start + 1], end - start - 1}
+    };
+}
+
 Token
 Lexer::character(enum Token::TYPE type)
 {
@@ -140,10 +182,21 @@ Lexer::next()
 {
     Token r {};
 
-    if (_pos >= _sFile._size)
+    if (!_aIdx.empty())
+    {
+        if (_idxI >= _aIdx._size)
             return r;
 
-    skipWhiteSpace();
+        /* whitespace is already skipped by the index */
+        _pos = _aIdx[_idxI++];
+    }
+    else
+    {
+        if (_pos >= _sFile._size)
+            return r;
+
+        skipWhiteSpace();
+    }
 
     switch (_sFile[_pos])
     {
@@ -168,7 +221,7 @@ Lexer::next()
             break;
 
         case Token::QUOTE:
-            r = string();
+            r = _aIdx.empty() ? string() : indexedString();
             break;
 
         case Token::COMMA:
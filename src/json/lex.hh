@@ -1,7 +1,9 @@
 #pragma once
 
 #include "String.hh"
+#include "Array.hh"
 #include "Allocator.hh"
+#include "file.hh"
 
 namespace json
 {
@@ -34,16 +36,24 @@ struct Lexer
     adt::Allocator* _pArena {};
     adt::String _sFile;
     u32 _pos = 0;
+    adt::MappedFile _mapped; /* `_sFile` points into it, keep mapped while the DOM is alive */
+    adt::Array<u32> _aIdx; /* stage-1 structural index, walked by `next()` when not empty */
+    u32 _idxI = 0;
 
     Lexer(adt::Allocator* p) : _pArena(p) {}
 
     void loadFile(adt::String path);
+    void loadString(adt::String sData); /* `sData` must be followed by a byte that ends a literal, like '\0' or '\n' */
+    void loadIndexed(adt::MappedFile mapped, adt::Array<u32> aIdx); /* takes over `mapped`, index from `buildIndex()` */
+    void destroy();
     void skipWhiteSpace();
     Token number();
     Token stringNoQuotes();
     Token string();
+    Token indexedString();
     Token character(enum Token::TYPE type);
     Token next();
+    Token at(u32 idxI) { _idxI = idxI; return next(); } /* token at index entry */
 };
 
 } /* namespace json */
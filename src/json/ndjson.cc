@@ -0,0 +1,129 @@
+#include <stdio.h>
+
+#include "ndjson.hh"
+#include "parser.hh"
+#include "logs.hh"
+
+namespace json
+{
+
+NdjsonReader::NdjsonReader(adt::Allocator* p, u32 chunkSize)
+    : _pAlloc(p), _chunkSize(chunkSize), _maxDepth(PARSER_DEFAULT_MAX_DEPTH) {}
+
+/* appends to the carried over record, keeping it '\0' terminated */
+void
+NdjsonReader::carry(const char* pData, u32 size)
+{
+    if (_aLine._size + size + 1 > _aLine._capacity)
+    {
+        u32 cap = _aLine._capacity * 2;
+        while (cap < _aLine._size + size + 1) cap *= 2;
+        _aLine.grow(cap);
+    }
+
+    memcpy(&_aLine[_aLine._size], pData, size);
+    _aLine._size += size;
+    _aLine[_aLine._size] = '\0';
+}
+
+bool
+NdjsonReader::record(adt::String sRecord, u64 line, adt::ArenaAllocator* pArena, RecordCallback pfn, void* pArgs)
+{
+    bool bBlank = true;
+    for (u32 i = 0; i < sRecord._size && bBlank; i++)
+        bBlank = sRecord[i] == ' ' || sRecord[i] == '\t' || sRecord[i] == '\r';
+
+    if (bBlank)
+        return true;
+
+    _nRecords++;
+    pArena->reset();
+
+    Parser p(pArena, _maxDepth);
+    p._sName = _sName;
+    p._bBigIntsAsStrings = _bBigIntsAsStrings;
+    p.loadString(sRecord);
+    p.parse();
+
+    if (!p.done())
+    {
+        CERR("(%.*s:%lu): unexpected data after the record\n", _sName._size, _sName._pData, line);
+        exit(2);
+    }
+
+    return pfn(p.getHeadObj(), line, pArgs);
+}
+
+u64
+NdjsonReader::read(adt::String path, adt::ArenaAllocator* pArena, RecordCallback pfn, void* pArgs)
+{
+    _sName = path;
+
+    auto sPath = adt::makeString(_pAlloc, path);
+    FILE* pf = fopen(sPath._pData, "rb");
+    _pAlloc->free(sPath._pData);
+
+    if (!pf)
+    {
+        CERR("(%.*s): failed to open\n", path._size, path._pData);
+        exit(1);
+    }
+
+    /* +1 for '\0' after the last byte read, a record can end right at the end of the file */
+    char* pChunk = (char*)_pAlloc->alloc(_chunkSize + 1, sizeof(char));
+    _aLine = adt::Array<char>(_pAlloc, adt::SIZE_8K);
+
+    u64 line = 0;
+    _nRecords = 0;
+    bool bGoing = true;
+    size_t nRead;
+
+    while (bGoing && (nRead = fread(pChunk, 1, _chunkSize, pf)) > 0)
+    {
+        pChunk[nRead] = '\0';
+        u32 start = 0;
+
+        while (bGoing)
+        {
+            auto* pNl = (char*)memchr(&pChunk[start], '\n', nRead - start);
+            if (!pNl)
+            {
+                carry(&pChunk[start], nRead - start);
+                break;
+            }
+
+            u32 end = pNl - pChunk;
+            line++;
+
+            if (_aLine._size > 0)
+            {
+                carry(&pChunk[start], end - start);
+                bGoing = record({_aLine._pData, _aLine._size}, line, pArena, pfn, pArgs);
+                _aLine._size = 0;
+            }
+            else
+            {
+                /* in place, the newline terminates the last literal */
+                bGoing = record({&pChunk[start], end - start}, line, pArena, pfn, pArgs);
+            }
+
+            start = end + 1;
+        }
+    }
+
+    /* no newline at the end of file */
+    if (bGoing && _aLine._size > 0)
+    {
+        line++;
+        record({_aLine._pData, _aLine._size}, line, pArena, pfn, pArgs);
+    }
+
+    fclose(pf);
+    _pAlloc->free(pChunk);
+    _aLine.destroy();
+    _aLine = {};
+
+    return _nRecords;
+}
+
+} /* namespace json */
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ast.hh"
+#include "ArenaAllocator.hh"
+
+namespace json
+{
+
+constexpr u32 NDJSON_DEFAULT_CHUNK_SIZE = 4 * adt::SIZE_1M;
+
+/* `pRecord` and its strings are only valid during the call. Return false to stop reading. */
+typedef bool (*RecordCallback)(Object* pRecord, u64 line, void* pArgs);
+
+/* Newline delimited JSON (JSON Lines) reader.
+ * The file is read `_chunkSize` bytes at a time, a record that spans chunks is carried over in `_aLine`.
+ * Every record is parsed into `pArena`, which is `reset()` before the next one, so memory stays at one chunk
+ * plus the largest record no matter how big the file is. Blank lines are skipped, any value is a valid record. */
+struct NdjsonReader
+{
+    adt::Allocator* _pAlloc; /* chunk and carry-over buffers */
+    u32 _chunkSize;
+    u32 _maxDepth;
+    bool _bBigIntsAsStrings = false;
+
+    NdjsonReader(adt::Allocator* p, u32 chunkSize = NDJSON_DEFAULT_CHUNK_SIZE);
+
+    u64 read(adt::String path, adt::ArenaAllocator* pArena, RecordCallback pfn, void* pArgs); /* returns number of records */
+
+private:
+    adt::Array<char> _aLine {};
+    adt::String _sName {};
+    u64 _nRecords = 0;
+
+    bool record(adt::String sRecord, u64 line, adt::ArenaAllocator* pArena, RecordCallback pfn, void* pArgs);
+    void carry(const char* pData, u32 size);
+};
+
+} /* namespace json */
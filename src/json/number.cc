@@ -0,0 +1,581 @@
+#include <locale.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "number.hh"
+#include "pow5.hh"
+#include "DefaultAllocator.hh"
+
+namespace json
+{
+
+static const double EXACT_POW10[] {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+constexpr u32 MAX_MANTISSA_DIGITS = 19;
+constexpr int MANTISSA_BITS = 52;
+constexpr int MIN_EXPONENT = -1023;
+constexpr int INFINITE_POWER = 0x7FF;
+
+static inline bool
+isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline double
+makeDouble(u64 mantissa, u64 power2, bool bNeg)
+{
+    u64 bits = mantissa | (power2 << MANTISSA_BITS) | (u64(bNeg) << 63);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+/* Correct fallback for inputs the fast paths can't decide: more than 19 significant digits
+ * or no 128-bit multiply. Copies to get NUL termination, parses in "C" locale. */
+static double
+slowPath(adt::String sv)
+{
+    char aBuff[128];
+    char* pBuff = aBuff;
+    if (sv._size >= sizeof(aBuff))
+        pBuff = (char*)adt::StdAllocator.alloc(sv._size + 1, sizeof(char));
+
+    memcpy(pBuff, sv._pData, sv._size);
+    pBuff[sv._size] = '\0';
+
+#ifdef __linux__
+    static locale_t s_cLocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+    double d = strtod_l(pBuff, nullptr, s_cLocale);
+#else
+    double d = strtod(pBuff, nullptr);
+#endif
+
+    if (pBuff != aBuff)
+        adt::StdAllocator.free(pBuff);
+
+    return d;
+}
+
+#ifdef __SIZEOF_INT128__
+
+/* Eisel-Lemire: w * 10^q rounded to nearest even from 128-bit approximation of 5^q.
+ * `w` is non-zero and exact. */
+static double
+eiselLemire(u64 w, s64 q, bool bNeg)
+{
+    if (q < POW5_MIN_EXP) return makeDouble(0, 0, bNeg);
+    if (q > POW5_MAX_EXP) return makeDouble(0, INFINITE_POWER, bNeg);
+
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+
+    u32 idx = 2 * u32(q - POW5_MIN_EXP);
+    unsigned __int128 first = (unsigned __int128)(w) * POW5_128[idx];
+    u64 high = u64(first >> 64), low = u64(first);
+
+    /* 55 bits of precision are needed, widen with low word of 5^q only if they are all ones */
+    constexpr u64 precisionMask = ~0ULL >> (MANTISSA_BITS + 3);
+    if ((high & precisionMask) == precisionMask)
+    {
+        u64 secondHigh = u64(((unsigned __int128)(w) * POW5_128[idx + 1]) >> 64);
+        low += secondHigh;
+        if (secondHigh > low) high++;
+    }
+
+    int upperBit = int(high >> 63);
+    int shift = upperBit + 64 - MANTISSA_BITS - 3;
+    u64 mantissa = high >> shift;
+    int power2 = int(((152170 + 65536) * q) >> 16) + 63 + upperBit - lz - MIN_EXPONENT;
+
+    /* subnormal */
+    if (power2 <= 0)
+    {
+        if (-power2 + 1 >= 64)
+            return makeDouble(0, 0, bNeg);
+
+        mantissa >>= -power2 + 1;
+        mantissa += (mantissa & 1);
+        mantissa >>= 1;
+        power2 = mantissa < (1ULL << MANTISSA_BITS) ? 0 : 1;
+        return makeDouble(mantissa & ~(1ULL << MANTISSA_BITS), power2, bNeg);
+    }
+
+    /* exactly halfway between two floats: round down to even */
+    if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1)
+    {
+        if ((mantissa << shift) == high)
+            mantissa &= ~1ULL;
+    }
+
+    mantissa += (mantissa & 1);
+    mantissa >>= 1;
+    if (mantissa >= (2ULL << MANTISSA_BITS))
+    {
+        mantissa = 1ULL << MANTISSA_BITS;
+        power2++;
+    }
+    mantissa &= ~(1ULL << MANTISSA_BITS);
+
+    if (power2 >= INFINITE_POWER)
+        return makeDouble(0, INFINITE_POWER, bNeg);
+
+    return makeDouble(mantissa, power2, bNeg);
+}
+
+#endif
+
+Number
+toNumber(adt::String sv)
+{
+    Number ret {.eType = Number::INVALID, .l = 0};
+
+    const char* p = sv._pData;
+    const char* pEnd = sv._pData + sv._size;
+
+    bool bNeg = p < pEnd && *p == '-';
+    if (bNeg) p++;
+
+    if (p >= pEnd || !isDigit(*p)) return ret;
+
+    const char* pStart = p;
+    u64 w = 0;
+
+    if (*p == '0')
+    {
+        p++;
+        if (p < pEnd && isDigit(*p)) return ret; /* no leading zeros */
+    }
+    else
+    {
+        for (; p < pEnd && isDigit(*p); p++)
+            w = w * 10 + u64(*p - '0');
+    }
+
+    u32 nDigits = p - pStart;
+    s64 exp10 = 0;
+    bool bInt = true;
+
+    if (p < pEnd && *p == '.')
+    {
+        bInt = false;
+        const char* pFrac = ++p;
+        for (; p < pEnd && isDigit(*p); p++)
+            w = w * 10 + u64(*p - '0');
+
+        if (p == pFrac) return ret;
+
+        nDigits += p - pFrac;
+        exp10 = -(p - pFrac);
+    }
+
+    if (p < pEnd && (*p == 'e' || *p == 'E'))
+    {
+        bInt = false;
+        p++;
+
+        bool bNegExp = p < pEnd && *p == '-';
+        if (p < pEnd && (*p == '-' || *p == '+')) p++;
+        if (p >= pEnd || !isDigit(*p)) return ret;
+
+        s64 e = 0;
+        for (; p < pEnd && isDigit(*p); p++)
+            if (e < 0x10000000) e = e * 10 + (*p - '0'); /* saturate, result is 0 or inf anyway */
+
+        exp10 += bNegExp ? -e : e;
+    }
+
+    if (p != pEnd) return ret;
+
+    /* leading zeros of 0.000ddd don't count towards precision */
+    if (nDigits > MAX_MANTISSA_DIGITS)
+    {
+        for (const char* z = pStart; z < pEnd && (*z == '0' || *z == '.'); z++)
+            if (*z == '0') nDigits--;
+    }
+
+    if (bInt)
+    {
+        constexpr u64 longMax = u64(~0UL >> 1);
+
+        if (nDigits <= MAX_MANTISSA_DIGITS && w <= longMax + u64(bNeg))
+        {
+            ret.eType = Number::LONG;
+            ret.l = bNeg ? long(0 - w) : long(w);
+            return ret;
+        }
+
+        ret.eType = Number::BIG_INT;
+    }
+    else
+    {
+        ret.eType = Number::DOUBLE;
+    }
+
+    if (nDigits > MAX_MANTISSA_DIGITS)
+    {
+        ret.d = slowPath(sv);
+    }
+    else if (w == 0)
+    {
+        ret.d = bNeg ? -0.0 : 0.0;
+    }
+    /* Clinger: both operands are exact doubles, so is the single rounding */
+    else if (exp10 >= -22 && exp10 <= 22 && w <= (1ULL << 53))
+    {
+        double d = double(w);
+        d = exp10 < 0 ? d / EXACT_POW10[-exp10] : d * EXACT_POW10[exp10];
+        ret.d = bNeg ? -d : d;
+    }
+    else
+    {
+#ifdef __SIZEOF_INT128__
+        ret.d = eiselLemire(w, exp10, bNeg);
+#else
+        ret.d = slowPath(sv);
+#endif
+    }
+
+    return ret;
+}
+
+static const char DIGITS_LUT[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+#ifdef __SIZEOF_INT128__
+
+/* Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers"):
+ * shortest digits in the vast majority of cases, always round-trips. */
+
+struct DiyFp
+{
+    u64 f;
+    int e;
+};
+
+/* normalized 10^k, k = -348 + 8i */
+static const u64 CACHED_POW10_F[] {
+    0xFA8FD5A0081C0288ULL, 0xBAAEE17FA23EBF76ULL, 0x8B16FB203055AC76ULL,
+    0xCF42894A5DCE35EAULL, 0x9A6BB0AA55653B2DULL, 0xE61ACF033D1A45DFULL,
+    0xAB70FE17C79AC6CAULL, 0xFF77B1FCBEBCDC4FULL, 0xBE5691EF416BD60CULL,
+    0x8DD01FAD907FFC3CULL, 0xD3515C2831559A83ULL, 0x9D71AC8FADA6C9B5ULL,
+    0xEA9C227723EE8BCBULL, 0xAECC49914078536DULL, 0x823C12795DB6CE57ULL,
+    0xC21094364DFB5637ULL, 0x9096EA6F3848984FULL, 0xD77485CB25823AC7ULL,
+    0xA086CFCD97BF97F4ULL, 0xEF340A98172AACE5ULL, 0xB23867FB2A35B28EULL,
+    0x84C8D4DFD2C63F3BULL, 0xC5DD44271AD3CDBAULL, 0x936B9FCEBB25C996ULL,
+    0xDBAC6C247D62A584ULL, 0xA3AB66580D5FDAF6ULL, 0xF3E2F893DEC3F126ULL,
+    0xB5B5ADA8AAFF80B8ULL, 0x87625F056C7C4A8BULL, 0xC9BCFF6034C13053ULL,
+    0x964E858C91BA2655ULL, 0xDFF9772470297EBDULL, 0xA6DFBD9FB8E5B88FULL,
+    0xF8A95FCF88747D94ULL, 0xB94470938FA89BCFULL, 0x8A08F0F8BF0F156BULL,
+    0xCDB02555653131B6ULL, 0x993FE2C6D07B7FACULL, 0xE45C10C42A2B3B06ULL,
+    0xAA242499697392D3ULL, 0xFD87B5F28300CA0EULL, 0xBCE5086492111AEBULL,
+    0x8CBCCC096F5088CCULL, 0xD1B71758E219652CULL, 0x9C40000000000000ULL,
+    0xE8D4A51000000000ULL, 0xAD78EBC5AC620000ULL, 0x813F3978F8940984ULL,
+    0xC097CE7BC90715B3ULL, 0x8F7E32CE7BEA5C70ULL, 0xD5D238A4ABE98068ULL,
+    0x9F4F2726179A2245ULL, 0xED63A231D4C4FB27ULL, 0xB0DE65388CC8ADA8ULL,
+    0x83C7088E1AAB65DBULL, 0xC45D1DF942711D9AULL, 0x924D692CA61BE758ULL,
+    0xDA01EE641A708DEAULL, 0xA26DA3999AEF774AULL, 0xF209787BB47D6B85ULL,
+    0xB454E4A179DD1877ULL, 0x865B86925B9BC5C2ULL, 0xC83553C5C8965D3DULL,
+    0x952AB45CFA97A0B3ULL, 0xDE469FBD99A05FE3ULL, 0xA59BC234DB398C25ULL,
+    0xF6C69A72A3989F5CULL, 0xB7DCBF5354E9BECEULL, 0x88FCF317F22241E2ULL,
+    0xCC20CE9BD35C78A5ULL, 0x98165AF37B2153DFULL, 0xE2A0B5DC971F303AULL,
+    0xA8D9D1535CE3B396ULL, 0xFB9B7CD9A4A7443CULL, 0xBB764C4CA7A44410ULL,
+    0x8BAB8EEFB6409C1AULL, 0xD01FEF10A657842CULL, 0x9B10A4E5E9913129ULL,
+    0xE7109BFBA19C0C9DULL, 0xAC2820D9623BF429ULL, 0x80444B5E7AA7CF85ULL,
+    0xBF21E44003ACDD2DULL, 0x8E679C2F5E44FF8FULL, 0xD433179D9C8CB841ULL,
+    0x9E19DB92B4E31BA9ULL, 0xEB96BF6EBADF77D9ULL, 0xAF87023B9BF0EE6BULL,
+};
+
+static const s16 CACHED_POW10_E[] {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const u64 POW10_U64[] {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static inline DiyFp
+diyMul(DiyFp l, DiyFp r)
+{
+    unsigned __int128 p = (unsigned __int128)(l.f) * r.f;
+    u64 h = u64(p >> 64);
+    if (u64(p) & (1ULL << 63)) h++; /* round */
+    return {h, l.e + r.e + 64};
+}
+
+static inline DiyFp
+diyNormalize(DiyFp x)
+{
+    int s = __builtin_clzll(x.f);
+    return {x.f << s, x.e - s};
+}
+
+static inline void
+grisuRound(char* pBuff, int len, u64 delta, u64 rest, u64 tenKappa, u64 wpW)
+{
+    while (rest < wpW && delta - rest >= tenKappa &&
+           (rest + tenKappa < wpW || wpW - rest > rest + tenKappa - wpW))
+    {
+        pBuff[len - 1]--;
+        rest += tenKappa;
+    }
+}
+
+static void
+digitGen(DiyFp w, DiyFp mp, u64 delta, char* pBuff, int* pLen, int* pK)
+{
+    DiyFp one {1ULL << -mp.e, mp.e};
+    u64 wpW = mp.f - w.f;
+    u32 p1 = u32(mp.f >> -one.e);
+    u64 p2 = mp.f & (one.f - 1);
+
+    int kappa = 1;
+    while (kappa < 10 && p1 >= POW10_U64[kappa]) kappa++;
+
+    *pLen = 0;
+    while (kappa > 0)
+    {
+        u32 div = u32(POW10_U64[kappa - 1]);
+        u32 d = p1 / div;
+        p1 %= div;
+
+        if (d || *pLen) pBuff[(*pLen)++] = char('0' + d);
+        kappa--;
+
+        u64 tmp = (u64(p1) << -one.e) + p2;
+        if (tmp <= delta)
+        {
+            *pK += kappa;
+            grisuRound(pBuff, *pLen, delta, tmp, POW10_U64[kappa] << -one.e, wpW);
+            return;
+        }
+    }
+
+    for (;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+        char d = char(p2 >> -one.e);
+        if (d || *pLen) pBuff[(*pLen)++] = char('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+
+        if (p2 < delta)
+        {
+            *pK += kappa;
+            int idx = -kappa;
+            grisuRound(pBuff, *pLen, delta, p2, one.f, wpW * (idx < 20 ? POW10_U64[idx] : 0));
+            return;
+        }
+    }
+}
+
+/* positive finite non-zero `d` to digits and decimal exponent: d ~ digits * 10^K */
+static void
+grisu2(double d, char* pBuff, int* pLen, int* pK)
+{
+    u64 bits;
+    memcpy(&bits, &d, sizeof(bits));
+
+    constexpr u64 hiddenBit = 1ULL << MANTISSA_BITS;
+    int biasedE = int((bits >> MANTISSA_BITS) & 0x7FF);
+    u64 significand = bits & (hiddenBit - 1);
+
+    DiyFp v = biasedE ? DiyFp {significand + hiddenBit, biasedE - 1075} : DiyFp {significand, -1074};
+
+    /* boundaries m+ and m- with the same exponent */
+    DiyFp plus {(v.f << 1) + 1, v.e - 1};
+    while (!(plus.f & (hiddenBit << 1)))
+    {
+        plus.f <<= 1;
+        plus.e--;
+    }
+    plus.f <<= 64 - MANTISSA_BITS - 2;
+    plus.e -= 64 - MANTISSA_BITS - 2;
+
+    DiyFp minus = v.f == hiddenBit ? DiyFp {(v.f << 2) - 1, v.e - 2} : DiyFp {(v.f << 1) - 1, v.e - 1};
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    /* cached power that brings the exponent into [-60, -32] */
+    double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    int k = int(dk);
+    if (dk - k > 0.0) k++;
+    u32 idx = u32((k >> 3) + 1);
+    *pK = -(-348 + int(idx << 3));
+    DiyFp cmk {CACHED_POW10_F[idx], CACHED_POW10_E[idx]};
+
+    DiyFp w = diyMul(diyNormalize(v), cmk);
+    DiyFp wp = diyMul(plus, cmk);
+    DiyFp wm = diyMul(minus, cmk);
+    wm.f++;
+    wp.f--;
+
+    digitGen(w, wp, wp.f - wm.f, pBuff, pLen, pK);
+}
+
+static char*
+writeExponent(int k, char* p)
+{
+    if (k < 0)
+    {
+        *p++ = '-';
+        k = -k;
+    }
+
+    if (k >= 100)
+    {
+        *p++ = char('0' + k / 100);
+        k %= 100;
+        memcpy(p, &DIGITS_LUT[k * 2], 2);
+        p += 2;
+    }
+    else if (k >= 10)
+    {
+        memcpy(p, &DIGITS_LUT[k * 2], 2);
+        p += 2;
+    }
+    else
+    {
+        *p++ = char('0' + k);
+    }
+
+    return p;
+}
+
+/* digits * 10^k in plain or scientific notation, always with '.' or 'e' so it reads back as double */
+static char*
+prettify(char* p, int len, int k)
+{
+    int kk = len + k; /* 10^(kk - 1) <= v < 10^kk */
+
+    if (0 <= k && kk <= 21)
+    {
+        /* 1234e7 -> 12340000000.0 */
+        for (int i = len; i < kk; i++) p[i] = '0';
+        p[kk] = '.';
+        p[kk + 1] = '0';
+        return &p[kk + 2];
+    }
+    else if (0 < kk && kk <= 21)
+    {
+        /* 1234e-2 -> 12.34 */
+        memmove(&p[kk + 1], &p[kk], len - kk);
+        p[kk] = '.';
+        return &p[len + 1];
+    }
+    else if (-6 < kk && kk <= 0)
+    {
+        /* 1234e-6 -> 0.001234 */
+        int off = 2 - kk;
+        memmove(&p[off], &p[0], len);
+        p[0] = '0';
+        p[1] = '.';
+        for (int i = 2; i < off; i++) p[i] = '0';
+        return &p[len + off];
+    }
+    else if (len == 1)
+    {
+        /* 1e30 */
+        p[1] = 'e';
+        return writeExponent(kk - 1, &p[2]);
+    }
+    else
+    {
+        /* 1234e30 -> 1.234e33 */
+        memmove(&p[2], &p[1], len - 1);
+        p[1] = '.';
+        p[len + 1] = 'e';
+        return writeExponent(kk - 1, &p[len + 2]);
+    }
+}
+
+#endif
+
+u32
+formatDouble(double d, char* pBuff)
+{
+    char* p = pBuff;
+
+    if (d != d || d - d != d - d)
+    {
+        /* nan and inf have no JSON representation */
+        memcpy(p, "null", 4);
+        return 4;
+    }
+
+    if (signbit(d))
+    {
+        *p++ = '-';
+        d = -d;
+    }
+
+    if (d == 0.0)
+    {
+        memcpy(p, "0.0", 3);
+        return u32(p - pBuff) + 3;
+    }
+
+#ifdef __SIZEOF_INT128__
+    int len, k;
+    grisu2(d, p, &len, &k);
+    p = prettify(p, len, k);
+    return u32(p - pBuff);
+#else
+    int n = snprintf(p, 32, "%.17g", d);
+    return u32(p - pBuff) + n;
+#endif
+}
+
+u32
+formatLong(long l, char* pBuff)
+{
+    char aTmp[24];
+    char* pEnd = aTmp + sizeof(aTmp);
+    char* p = pEnd;
+
+    u64 u = l < 0 ? 0 - u64(l) : u64(l);
+
+    while (u >= 100)
+    {
+        u32 r = u32(u % 100);
+        u /= 100;
+        p -= 2;
+        memcpy(p, &DIGITS_LUT[r * 2], 2);
+    }
+
+    if (u >= 10)
+    {
+        p -= 2;
+        memcpy(p, &DIGITS_LUT[u * 2], 2);
+    }
+    else
+    {
+        *--p = char('0' + u);
+    }
+
+    if (l < 0) *--p = '-';
+
+    u32 n = u32(pEnd - p);
+    memcpy(pBuff, p, n);
+    return n;
+}
+
+} /* namespace json */
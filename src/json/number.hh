@@ -0,0 +1,34 @@
+#pragma once
+
+#include "String.hh"
+
+namespace json
+{
+
+struct Number
+{
+    enum TYPE : u8
+    {
+        LONG,
+        DOUBLE,
+        BIG_INT, /* integer literal that doesn't fit in long, `d` holds the closest double */
+        INVALID
+    } eType;
+    union {
+        long l;
+        double d;
+    };
+};
+
+/* Converts full JSON number grammar literal: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+ * Locale independent, doesn't read past `sv`. Doubles are correctly rounded. */
+Number toNumber(adt::String sv);
+
+/* Shortest round-trip representation (Grisu2), `pBuff` needs 32 bytes. Non-finite values are written as null.
+ * Returns number of bytes written, no '\0'. */
+u32 formatDouble(double d, char* pBuff);
+
+/* `pBuff` needs 20 bytes. Returns number of bytes written, no '\0'. */
+u32 formatLong(long l, char* pBuff);
+
+} /* namespace json */
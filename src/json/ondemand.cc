@@ -0,0 +1,230 @@
+#include "ondemand.hh"
+#include "number.hh"
+
+namespace json
+{
+
+static inline char
+charAt(Lexer* pL, u32 i)
+{
+    return i < pL->_aIdx._size ? pL->_sFile[pL->_aIdx[i]] : '\0';
+}
+
+/* index entry right after the value that starts at `i` */
+static u32
+skipValue(Lexer* pL, u32 i)
+{
+    switch (charAt(pL, i))
+    {
+        default:
+            return i + 1;
+
+        case '"':
+            return i + 2;
+
+        case '{':
+        case '[':
+            {
+                /* strings have both quotes indexed and nothing in between, only brackets matter */
+                int depth = 0;
+                do
+                {
+                    switch (charAt(pL, i))
+                    {
+                        default: break;
+
+                        case '{':
+                        case '[':
+                            depth++;
+                            break;
+
+                        case '}':
+                        case ']':
+                            depth--;
+                            break;
+                    }
+                    i++;
+                }
+                while (depth > 0 && i < pL->_aIdx._size);
+            }
+            return i;
+    }
+}
+
+/* `Number::INVALID` if `i` is not a well formed number */
+static Number
+numberAt(Lexer* pL, u32 i)
+{
+    if (i >= pL->_aIdx._size)
+        return {.eType = Number::INVALID, .l = 0};
+
+    Token t = pL->at(i);
+    if (t.type != Token::NUMBER)
+        return {.eType = Number::INVALID, .l = 0};
+
+    return toNumber(t.svLiteral);
+}
+
+void
+OnDemand::load(adt::String path)
+{
+    _sName = path;
+    _l.loadFile(path);
+}
+
+TAG
+Cursor::getTag()
+{
+    if (!valid() || !_pL)
+        return TAG::INVALID;
+
+    switch (charAt(_pL, _i))
+    {
+        case '{': return TAG::OBJECT;
+        case '[': return TAG::ARRAY;
+        case '"': return TAG::STRING;
+
+        /* whole word, `tru` or `nul` is not a literal */
+        case 't':
+        case 'f':
+        case 'n':
+            switch (_pL->at(_i).type)
+            {
+                case Token::TRUE_:
+                case Token::FALSE_: return TAG::BOOL;
+                case Token::NULL_: return TAG::NULL_;
+                default: return TAG::INVALID;
+            }
+
+        default:
+            switch (numberAt(_pL, _i).eType)
+            {
+                case Number::LONG: return TAG::LONG;
+                case Number::INVALID: return TAG::INVALID;
+                default: return TAG::DOUBLE;
+            }
+    }
+}
+
+Cursor
+Cursor::findField(adt::String svKey)
+{
+    for (CursorField f : fields())
+        if (f.val.valid() && f.svKey == svKey)
+            return f.val;
+
+    return {_pL, adt::NPOS};
+}
+
+Cursor
+Cursor::at(u32 i)
+{
+    u32 n = 0;
+    for (Cursor c : elems())
+        if (n++ == i)
+            return c;
+
+    return {_pL, adt::NPOS};
+}
+
+bool
+Cursor::getLong(long* pL)
+{
+    if (!valid() || !_pL) return false;
+
+    Number num = numberAt(_pL, _i);
+    if (num.eType != Number::LONG) return false;
+
+    *pL = num.l;
+    return true;
+}
+
+bool
+Cursor::getDouble(double* pD)
+{
+    if (!valid() || !_pL) return false;
+
+    Number num = numberAt(_pL, _i);
+    if (num.eType == Number::INVALID) return false;
+
+    *pD = num.eType == Number::LONG ? double(num.l) : num.d;
+    return true;
+}
+
+bool
+Cursor::getString(adt::String* pS)
+{
+    if (!valid() || !_pL || charAt(_pL, _i) != '"' || _i + 1 >= _pL->_aIdx._size)
+        return false;
+
+    u32 start = _pL->_aIdx[_i], end = _pL->_aIdx[_i + 1];
+    *pS = {&_pL->_sFile[start + 1], end - start - 1};
+    return true;
+}
+
+bool
+Cursor::getBool(bool* pB)
+{
+    if (!valid() || !_pL || _i >= _pL->_aIdx._size) return false;
+
+    Token t = _pL->at(_i);
+    if (t.type != Token::TRUE_ && t.type != Token::FALSE_) return false;
+
+    *pB = t.type == Token::TRUE_;
+    return true;
+}
+
+/* key quote, closing quote, ':', then value */
+static bool
+isMember(Lexer* pL, u32 i)
+{
+    return charAt(pL, i) == '"' && charAt(pL, i + 2) == ':';
+}
+
+/* invalid key and value if the member is malformed */
+CursorField
+CursorFieldIt::operator*() const
+{
+    if (!isMember(_pL, _i))
+        return {{}, {_pL, adt::NPOS}};
+
+    Cursor key {_pL, _i};
+    adt::String svKey {};
+    key.getString(&svKey);
+    return {svKey, {_pL, _i + 3}};
+}
+
+/* stops at a malformed member */
+CursorFieldIt
+CursorFieldIt::operator++()
+{
+    u32 after = skipValue(_pL, _i + 3);
+    _i = charAt(_pL, after) == ',' && isMember(_pL, after + 1) ? after + 1 : adt::NPOS;
+    return *this;
+}
+
+CursorElemIt
+CursorElemIt::operator++()
+{
+    u32 after = skipValue(_pL, _i);
+    _i = charAt(_pL, after) == ',' ? after + 1 : adt::NPOS;
+    return *this;
+}
+
+/* `_i` is NPOS for anything but an object, `_i + 1` would wrap to the root */
+CursorFieldIt
+CursorFields::begin()
+{
+    if (_i == adt::NPOS) return end();
+    return {_pL, isMember(_pL, _i + 1) ? _i + 1 : adt::NPOS};
+}
+
+CursorElemIt
+CursorElems::begin()
+{
+    if (_i == adt::NPOS) return end();
+    u32 first = _i + 1;
+    return {_pL, (charAt(_pL, first) == ']' || first >= _pL->_aIdx._size) ? adt::NPOS : first};
+}
+
+} /* namespace json */
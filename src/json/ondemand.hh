@@ -0,0 +1,112 @@
+#pragma once
+
+#include "lex.hh"
+#include "ast.hh"
+
+namespace json
+{
+
+struct CursorFields;
+struct CursorElems;
+
+/* Lazy view of one value in the raw buffer, addressed by its entry in the lexer's structural index.
+ * Nothing is converted until a getter is called, unneeded subtrees are skipped by bracket matching.
+ * Only the parts that are touched are validated.
+ * Missing values are normal: `findField()`/`at()` return an invalid cursor, which has `TAG::INVALID`,
+ * no fields or elements, and gives invalid cursors again. Getters return false on an invalid cursor or
+ * a value of the wrong type and leave the output untouched. */
+struct Cursor
+{
+    Lexer* _pL {};
+    u32 _i = adt::NPOS; /* index entry of the first token */
+
+    bool valid() const { return _i != adt::NPOS; }
+    TAG getTag(); /* `TAG::INVALID` if not valid or the literal is malformed */
+
+    Cursor findField(adt::String svKey); /* invalid if not found or not an object */
+    Cursor at(u32 i); /* i-th array element, invalid if out of range or not an array */
+
+    bool getLong(long* pL); /* integers only */
+    bool getDouble(double* pD); /* any number */
+    bool getString(adt::String* pS); /* raw, escapes as in the source */
+    bool getBool(bool* pB);
+    bool isNull() { return getTag() == TAG::NULL_; }
+
+    CursorFields fields(); /* empty unless an object */
+    CursorElems elems(); /* empty unless an array */
+};
+
+struct CursorField
+{
+    adt::String svKey;
+    Cursor val;
+};
+
+struct CursorFieldIt
+{
+    Lexer* _pL;
+    u32 _i; /* opening quote of the key */
+
+    CursorField operator*() const;
+    CursorFieldIt operator++();
+    friend bool operator==(const CursorFieldIt& l, const CursorFieldIt& r) { return l._i == r._i; }
+    friend bool operator!=(const CursorFieldIt& l, const CursorFieldIt& r) { return l._i != r._i; }
+};
+
+struct CursorElemIt
+{
+    Lexer* _pL;
+    u32 _i;
+
+    Cursor operator*() const { return {_pL, _i}; }
+    CursorElemIt operator++();
+    friend bool operator==(const CursorElemIt& l, const CursorElemIt& r) { return l._i == r._i; }
+    friend bool operator!=(const CursorElemIt& l, const CursorElemIt& r) { return l._i != r._i; }
+};
+
+struct CursorFields
+{
+    Lexer* _pL;
+    u32 _i;
+
+    CursorFieldIt begin();
+    CursorFieldIt end() { return {_pL, adt::NPOS}; }
+};
+
+struct CursorElems
+{
+    Lexer* _pL;
+    u32 _i;
+
+    CursorElemIt begin();
+    CursorElemIt end() { return {_pL, adt::NPOS}; }
+};
+
+inline CursorFields
+Cursor::fields()
+{
+    return {_pL, getTag() == TAG::OBJECT ? _i : adt::NPOS};
+}
+
+inline CursorElems
+Cursor::elems()
+{
+    return {_pL, getTag() == TAG::ARRAY ? _i : adt::NPOS};
+}
+
+/* On-demand document: maps and indexes the file, builds no DOM */
+struct OnDemand
+{
+    adt::String _sName;
+
+    OnDemand(adt::Allocator* p) : _l(p) {}
+
+    void load(adt::String path);
+    Cursor getRoot() { return {&_l, _l._aIdx.empty() ? adt::NPOS : 0}; }
+    void destroy() { _l.destroy(); }
+
+private:
+    Lexer _l;
+};
+
+} /* namespace json */
@@ -1,16 +1,47 @@
+#include <new>
+
 #include "parser.hh"
+#include "index.hh"
+#include "number.hh"
+#include "writer.hh"
 #include "utils.hh"
 #include "logs.hh"
+#include "DefaultAllocator.hh"
+#include "parallel.hh"
 
 namespace json
 {
 
+/* empty containers get no buffer, `push()` grows from 0 capacity if something is added later */
+static adt::Array<Object>
+makeMembers(adt::Allocator* pAlloc, u32 count)
+{
+    if (count > 0) return adt::Array<Object>(pAlloc, count);
+
+    adt::Array<Object> a;
+    a._pAlloc = pAlloc;
+    return a;
+}
+
 void
 Parser::load(adt::String path)
 {
     _sName = path;
     _l.loadFile(path);
+    start();
+}
+
+void
+Parser::loadIndexed(adt::String path, adt::MappedFile mapped, adt::Array<u32> aIdx)
+{
+    _sName = path;
+    _l.loadIndexed(mapped, aIdx);
+    start();
+}
 
+void
+Parser::start()
+{
     _tCurr = _l.next();
     _tNext = _l.next();
 
@@ -21,174 +52,371 @@ Parser::load(adt::String path)
     }
 
     _pHead = (Object*)(_pArena->alloc(1, sizeof(Object)));
+    *_pHead = {};
+}
+
+void
+Parser::loadString(adt::String sData)
+{
+    _l.loadString(sData);
+
+    _tCurr = _l.next();
+    _tNext = _l.next();
+
+    _pHead = (Object*)(_pArena->alloc(1, sizeof(Object)));
+    *_pHead = {};
 }
 
 void
 Parser::parse()
 {
-    parseNode(_pHead);
+    /* containers that are still open, innermost on top */
+    adt::Array<Object*> aStack(_pArena, _maxDepth);
+    parseValue(_pHead, &aStack);
+    aStack.destroy();
 }
 
 void
-Parser::expect(enum Token::TYPE t, adt::String svFile, int line)
+Parser::countElements()
 {
-    if (_tCurr.type != t)
-    {
-        CERR("('%.*s', at %d): (%.*s): unexpected token: expected: '%c', got '%c'\n",
-             svFile._size, svFile._pData, line, _sName._size, _sName._pData, char(t), char(_tCurr.type));
-        exit(2);
-    }
+    setElementCounts(json::countElements(_pArena, _l._sFile, _l._aIdx));
 }
 
 void
-Parser::next()
+Parser::destroy()
 {
-    _tCurr = _tNext;
-    _tNext = _l.next();
+    if (_pChunkArena)
+    {
+        _pChunkArena->freeAll();
+        _pArena->free(_pChunkArena);
+        _pChunkArena = nullptr;
+    }
+
+    _l.destroy();
 }
 
+/* One contiguous run of top-level array elements */
+struct ParseChunk
+{
+    Parser* pParser;
+    adt::Allocator* pArena;
+    u32 begin; /* index entry of the first element */
+    u32 end; /* separating comma after the last element or the closing bracket */
+    u32 nElems; /* exact, from the split scan */
+    u32 countI; /* first container of the chunk in `_aElemCounts` order */
+    adt::Array<Object> aElems;
+};
+
+/* Structural index is built before any split is made, so string contents are never looked at here:
+ * every indexed '[', '{', ']', '}' and ',' is real structure. Root array commas are picked as split points
+ * once at least `fileSize / nChunks` bytes went into the current chunk. Each chunk is parsed by its own
+ * `Parser` over a view of the index into `_pChunkArena`, then the element arrays are copied into the root
+ * in order. Nested values are not copied and stay in `_pChunkArena`. */
 void
-Parser::parseNode(Object* pNode)
+Parser::parseParallel(adt::ThreadPool* pPool)
 {
-    switch (_tCurr.type)
+    auto& aIdx = _l._aIdx;
+
+    if (_tCurr.type != Token::LBRACKET || aIdx.empty() || _l._sFile._size < PARSER_PARALLEL_MIN_SIZE)
     {
-        default:
-            next();
-            break;
+        parse();
+        return;
+    }
 
-        case Token::IDENT:
-            parseIdent(&pNode->tagVal);
-            break;
+    u32 nChunks = pPool->_threadCount * PARSER_CHUNKS_PER_THREAD;
+    u32 chunkSize = _l._sFile._size / nChunks;
+    adt::Array<ParseChunk> aChunks(_pArena, nChunks + 1);
+    ParseChunk chunk {.pParser = this, .pArena = nullptr, .begin = 1, .end = 0, .nElems = 1, .countI = 1, .aElems = {}};
+    u32 nextSplit = chunkSize;
+    u32 nOpened = 0;
+    u32 close = adt::NPOS;
+    int depth = 0;
 
-        case Token::NUMBER:
-            parseNumber(&pNode->tagVal);
-            break;
+    for (u32 i = 0; i < aIdx._size && close == adt::NPOS; i++)
+    {
+        switch (_l._sFile[aIdx[i]])
+        {
+            default:
+                break;
 
-        case Token::LBRACE:
-            next(); /* skip brace */
-            parseObject(pNode);
-            break;
+            case '[':
+            case '{':
+                depth++;
+                nOpened++;
+                break;
 
-        case Token::LBRACKET:
-            next(); /* skip bracket */
-            parseArray(pNode);
-            break;
+            case ']':
+            case '}':
+                if (--depth == 0) close = i;
+                break;
 
-        case Token::NULL_:
-            parseNull(&pNode->tagVal);
-            break;
+            case ',':
+                if (depth != 1)
+                    break;
 
-        case Token::TRUE_:
-        case Token::FALSE_:
-            parseBool(&pNode->tagVal);
-            break;
+                if (aIdx[i] >= nextSplit)
+                {
+                    chunk.end = i;
+                    aChunks.push(chunk);
+                    chunk.begin = i + 1;
+                    chunk.nElems = 1;
+                    chunk.countI = nOpened;
+                    nextSplit = aIdx[i] + chunkSize;
+                }
+                else
+                {
+                    chunk.nElems++;
+                }
+                break;
+        }
     }
-}
 
-void
-Parser::parseIdent(TagVal* pTV)
-{
-    *pTV = {.tag = TAG::STRING, .val {.sv = _tCurr.svLiteral}};
-    next();
-}
+    /* empty or malformed root, leave the errors to `parse()` */
+    if (close == adt::NPOS || close <= 1)
+    {
+        aChunks.destroy();
+        parse();
+        return;
+    }
 
-void
-Parser::parseNumber(TagVal* pTV)
-{
-    bool bReal = adt::findLastOf(_tCurr.svLiteral, '.') != adt::NPOS;
+    chunk.end = close;
+    aChunks.push(chunk);
 
-    if (bReal)
-        *pTV = {.tag = TAG::DOUBLE, .val = {.d = atof(_tCurr.svLiteral.data())}};
-    else
-        *pTV = TagVal{.tag = TAG::LONG, .val = {.l = atol(_tCurr.svLiteral.data())}};
+    /* Workers allocate from their own blocks, no lock. Any thread helping this pool can run a chunk, not only
+     * its workers, so slots are released after each chunk and extra threads share the overflow slot. */
+    if (!_pChunkArena)
+    {
+        _pChunkArena = (adt::ThreadArenaAllocator*)_pArena->alloc(1, sizeof(adt::ThreadArenaAllocator));
+        new(_pChunkArena) adt::ThreadArenaAllocator(PARSER_CHUNK_BLOCK_SIZE, pPool->_threadCount + 1);
+    }
 
-    next();
-}
+    for (auto& c : aChunks)
+        c.pArena = _pChunkArena;
 
-void
-Parser::parseObject(Object* pNode)
-{
-    pNode->tagVal.tag = TAG::OBJECT;
-    pNode->tagVal.val.o = adt::Array<Object>(_pArena, 8);
-    auto& aObjs = getObject(pNode);
+    /* waits for these chunks only, other users of the pool are not waited on */
+    adt::parallelFor(pPool, 0, aChunks._size, 1, [&](u32 i) { parseChunk(&aChunks[i]); });
 
-    for (; _tCurr.type != Token::RBRACE; next())
+    u32 total = 0;
+    for (auto& c : aChunks)
+        total += c.aElems._size;
+
+    _pHead->tagVal = {.tag = TAG::ARRAY, .val {.a = adt::Array<Object>(_pArena, total)}};
+    auto& aRoot = getArray(_pHead);
+    for (auto& c : aChunks)
     {
-        expect(Token::IDENT, __FILE__, __LINE__);
-        Object ob {.svKey = _tCurr.svLiteral, .tagVal = {}};
-        aObjs.push(ob);
+        memcpy(&aRoot[aRoot._size], c.aElems._pData, c.aElems._size * sizeof(Object));
+        aRoot._size += c.aElems._size;
+    }
 
-        /* skip identifier and ':' */
-        next();
-        expect(Token::ASSIGN, __FILE__, __LINE__);
-        next();
+    aChunks.destroy();
 
-        parseNode(&aObjs.back());
+    /* leave the lexer past the root like `parse()` does */
+    _l._idxI = close + 1;
+    next();
+    next();
+}
 
-        if (_tCurr.type != Token::COMMA)
-        {
-            next();
+int
+Parser::parseChunk(void* pArg)
+{
+    auto* pChunk = (ParseChunk*)pArg;
+    Parser* pSelf = pChunk->pParser;
+
+    Parser p(pChunk->pArena, pSelf->_maxDepth);
+    p._sName = pSelf->_sName;
+    p._bBigIntsAsStrings = pSelf->_bBigIntsAsStrings;
+    p._aElemCounts = pSelf->_aElemCounts;
+    p._countI = pChunk->countI;
+    p._l._sFile = pSelf->_l._sFile;
+
+    /* the lexer runs out of entries (EOF) at the chunk's end */
+    p._l._aIdx = pSelf->_l._aIdx;
+    p._l._aIdx._pData += pChunk->begin;
+    p._l._aIdx._size = p._l._aIdx._capacity = pChunk->end - pChunk->begin;
+    p._tCurr = p._l.next();
+    p._tNext = p._l.next();
+
+    adt::Array<Object*> aStack(pChunk->pArena, p._maxDepth);
+    pChunk->aElems = adt::Array<Object>(pChunk->pArena, pChunk->nElems);
+
+    for (;;)
+    {
+        Object* pNode = pChunk->aElems.push({});
+        p.parseValue(pNode, &aStack);
+
+        if (p._tCurr.type != Token::COMMA)
             break;
-        }
+
+        p.next();
     }
 
-    if (aObjs.empty())
-        next();
+    p.expect(Token::EOF_, __FILE__, __LINE__);
+    pSelf->_pChunkArena->release();
+
+    return thrd_success;
 }
 
+/* Parses one value starting at `_tCurr` into `pNode`, `pStack` must be empty */
 void
-Parser::parseArray(Object* pNode)
+Parser::parseValue(Object* pNode, adt::Array<Object*>* pStack)
 {
-    pNode->tagVal.tag = TAG::ARRAY;
-    pNode->tagVal.val.a = adt::Array<Object>(_pArena, 8);
-    auto& aTVs = getArray(pNode);
+    auto& aStack = *pStack;
 
-    /* collect each key/value pair inside array */
-    for (; _tCurr.type != Token::RBRACKET; next())
+    for (;;)
     {
-        aTVs.push({});
-
         switch (_tCurr.type)
         {
             default:
+                CERR("('%s', at %d): (%.*s): unexpected token: '%c'\n",
+                     __FILE__, __LINE__, _sName._size, _sName._pData, char(_tCurr.type));
+                exit(2);
+
             case Token::IDENT:
-                parseIdent(&aTVs.back().tagVal);
+                parseIdent(&pNode->tagVal);
+                break;
+
+            case Token::NUMBER:
+                parseNumber(&pNode->tagVal);
                 break;
 
             case Token::NULL_:
-                parseNull(&aTVs.back().tagVal);
+                parseNull(&pNode->tagVal);
                 break;
 
             case Token::TRUE_:
             case Token::FALSE_:
-                parseBool(&aTVs.back().tagVal);
-                break;
-
-            case Token::NUMBER:
-                parseNumber(&aTVs.back().tagVal);
+                parseBool(&pNode->tagVal);
                 break;
 
             case Token::LBRACE:
-                next();
-                parseObject(&aTVs.back());
-                break;
+            case Token::LBRACKET:
+                {
+                    bool bObj = _tCurr.type == Token::LBRACE;
+                    pNode->tagVal.tag = bObj ? TAG::OBJECT : TAG::ARRAY;
+                    pNode->tagVal.val.o = makeMembers(_pArena, nextCount());
+                    next(); /* skip brace */
+
+                    if (_tCurr.type == (bObj ? Token::RBRACE : Token::RBRACKET))
+                    {
+                        next();
+                        break;
+                    }
+
+                    if (aStack._size >= _maxDepth)
+                    {
+                        CERR("(%.*s): max depth (%u) exceeded\n", _sName._size, _sName._pData, _maxDepth);
+                        exit(2);
+                    }
+
+                    aStack.push(pNode);
+                    pNode = pushMember(pNode);
+                }
+                continue;
         }
 
-        if (_tCurr.type != Token::COMMA)
+        /* value is done: either next member of the innermost container or close it */
+        while (!aStack.empty())
         {
+            Object* pParent = aStack.back();
+
+            if (_tCurr.type == Token::COMMA)
+            {
+                next();
+                pNode = pushMember(pParent);
+                break;
+            }
+
+            expect(pParent->tagVal.tag == TAG::OBJECT ? Token::RBRACE : Token::RBRACKET, __FILE__, __LINE__);
             next();
-            break;
+            aStack.pop();
         }
+
+        if (aStack.empty())
+            break;
+    }
+}
+
+void
+Parser::expect(enum Token::TYPE t, adt::String svFile, int line)
+{
+    if (_tCurr.type != t)
+    {
+        CERR("('%.*s', at %d): (%.*s): unexpected token: expected: '%c', got '%c'\n",
+             svFile._size, svFile._pData, line, _sName._size, _sName._pData, char(t), char(_tCurr.type));
+        exit(2);
     }
+}
 
-    if (aTVs.empty())
+void
+Parser::next()
+{
+    _tCurr = _tNext;
+    _tNext = _l.next();
+}
+
+Object*
+Parser::pushMember(Object* pParent)
+{
+    adt::String svKey {};
+
+    if (pParent->tagVal.tag == TAG::OBJECT)
+    {
+        expect(Token::IDENT, __FILE__, __LINE__);
+        svKey = _tCurr.svLiteral;
+
+        /* skip identifier and ':' */
+        next();
+        expect(Token::ASSIGN, __FILE__, __LINE__);
         next();
+    }
+
+    /* value parsers keep `eRaw` */
+    return getObject(pParent).push({.svKey = svKey, .tagVal = {.tag = TAG::NULL_, .eRaw = svKey._pData ? RAW_KEY : RAW_NONE, .val {}}});
+}
+
+void
+Parser::parseIdent(TagVal* pTV)
+{
+    *pTV = {.tag = TAG::STRING, .eRaw = u8(pTV->eRaw | RAW_STRING), .val {.sv = _tCurr.svLiteral}};
+    next();
+}
+
+void
+Parser::parseNumber(TagVal* pTV)
+{
+    Number num = toNumber(_tCurr.svLiteral);
+
+    switch (num.eType)
+    {
+        case Number::LONG:
+            *pTV = {.tag = TAG::LONG, .eRaw = pTV->eRaw, .val = {.l = num.l}};
+            break;
+
+        case Number::BIG_INT:
+            if (_bBigIntsAsStrings)
+            {
+                *pTV = {.tag = TAG::STRING, .eRaw = u8(pTV->eRaw | RAW_STRING), .val = {.sv = _tCurr.svLiteral}};
+                break;
+            }
+            [[fallthrough]];
+
+        case Number::DOUBLE:
+            *pTV = {.tag = TAG::DOUBLE, .eRaw = pTV->eRaw, .val = {.d = num.d}};
+            break;
+
+        case Number::INVALID:
+            CERR("(%.*s): invalid number: '%.*s'\n",
+                 _sName._size, _sName._pData, _tCurr.svLiteral._size, _tCurr.svLiteral._pData);
+            exit(2);
+    }
+
+    next();
 }
 
 void
 Parser::parseNull(TagVal* pTV)
 {
-    *pTV = {.tag = TAG::NULL_, .val = {nullptr}};
+    *pTV = {.tag = TAG::NULL_, .eRaw = pTV->eRaw, .val = {nullptr}};
     next();
 }
 
@@ -196,19 +424,32 @@ void
 Parser::parseBool(TagVal* pTV)
 {
     bool b = _tCurr.type == Token::TRUE_ ? true : false;
-    *pTV = {.tag = TAG::BOOL, .val = {.b = b}};
+    *pTV = {.tag = TAG::BOOL, .eRaw = pTV->eRaw, .val = {.b = b}};
     next();
 }
 
 void
 Parser::print()
 {
-    printNode(_pHead, "", 0);
+    Writer w(_pArena, true, sinkFILE, stdout);
+    w.write(_pHead);
+    w.flush();
+    w.destroy();
     COUT("\n");
 }
 
-void
-printNode(Object* pNode, adt::String svEnd, int depth)
+struct PrintFrame
+{
+    Object* pNode;
+    u32 i;
+    adt::String svEnd;
+    int depth;
+};
+
+/* Prints scalars whole and the opening of containers.
+ * Returns true if container members and closing are left to print. */
+static bool
+printBegin(Object* pNode, bool bKey, adt::String svEnd, int depth)
 {
     adt::String key = pNode->svKey;
 
@@ -218,173 +459,141 @@ printNode(Object* pNode, adt::String svEnd, int depth)
             break;
 
         case TAG::OBJECT:
-            {
-                auto& obj = getObject(pNode);
-                adt::String q0, q1, objName0, objName1;
-
-                if (key._size == 0)
-                {
-                    q0 = q1 = objName1 = objName0 = "";
-                }
-                else
-                {
-                    objName0 = key;
-                    objName1 = ": ";
-                    q1 = q0 = "\"";
-                }
-
-                COUT("%*s", depth, "");
-                COUT("%.*s%.*s%.*s%.*s{\n", q0._size, q0._pData, objName0._size, objName0._pData, q1._size, q1._pData, objName1._size, objName1._pData);
-                for (u32 i = 0; i < obj._size; i++)
-                {
-                    adt::String slE = (i == obj._size - 1) ? "\n" : ",\n";
-                    printNode(&obj[i], slE, depth + 2);
-                }
-                COUT("%*s", depth, "");
-                COUT("}%.*s", svEnd._size, svEnd._pData);
-            }
-            break;
-
         case TAG::ARRAY:
             {
-                auto& arr = getArray(pNode);
-                adt::String q0, q1, arrName0, arrName1;
+                bool bObj = pNode->tagVal.tag == TAG::OBJECT;
+                adt::String q0, q1, name0, name1;
 
                 if (key._size == 0)
                 {
-                    q0 =  q1 = arrName1 = arrName0 = "";
+                    q0 = q1 = name1 = name0 = "";
                 }
                 else
                 {
-                    arrName0 = key;
-                    arrName1 = ": ";
+                    name0 = key;
+                    name1 = ": ";
                     q1 = q0 = "\"";
                 }
 
                 COUT("%*s", depth, "");
+                COUT("%.*s%.*s%.*s%.*s", q0._size, q0._pData, name0._size, name0._pData, q1._size, q1._pData, name1._size, name1._pData);
 
-                if (arr.empty())
+                if (!bObj && getArray(pNode).empty())
                 {
-                    COUT("%.*s%.*s%.*s%.*s[", q0._size, q0._pData, arrName0._size, arrName0._pData, q1._size, q1._pData, arrName1._size, arrName1._pData);
-                    COUT("]%.*s", (int)svEnd._size, svEnd._pData);
-                    break;
+                    COUT("[]%.*s", svEnd._size, svEnd._pData);
+                    return false;
                 }
 
-                COUT("%.*s%.*s%.*s%.*s[\n", q0._size, q0._pData, arrName0._size, arrName0._pData, q1._size, q1._pData, arrName1._size, arrName1._pData);
-                for (u32 i = 0; i < arr._size; i++)
-                {
-                    adt::String slE = (i == arr._size - 1) ? "\n" : ",\n";
-
-                    switch (arr[i].tagVal.tag)
-                    {
-                        default:
-                        case TAG::STRING:
-                            {
-                                adt::String sl = getString(&arr[i]);
-                                COUT("%*s", depth + 2, "");
-                                COUT("\"%.*s\"%.*s", sl._size, sl._pData, slE._size, slE._pData);
-                            }
-                            break;
-
-                        case TAG::NULL_:
-                                COUT("%*s", depth + 2, "");
-                                COUT("%s%.*s", "null", slE._size, slE._pData);
-                            break;
-
-                        case TAG::LONG:
-                            {
-                                long num = getLong(&arr[i]);
-                                COUT("%*s", depth + 2, "");
-                                COUT("%ld%.*s", num, slE._size, slE._pData);
-                            }
-                            break;
-
-                        case TAG::DOUBLE:
-                            {
-                                double dnum = getDouble(&arr[i]);
-                                COUT("%*s", depth + 2, "");
-                                COUT("%.17lf%.*s", dnum, slE._size, slE._pData);
-                            }
-                            break;
-
-                        case TAG::BOOL:
-                            {
-                                bool b = getBool(&arr[i]);
-                                COUT("%*s", depth + 2, "");
-                                COUT("%s%.*s", b ? "true" : "false", slE._size, slE._pData);
-                            }
-                            break;
-
-                        case TAG::OBJECT:
-                                printNode(&arr[i], slE, depth + 2);
-                            break;
-                    }
-                }
-                COUT("%*s", depth, "");
-                COUT("]%.*s", (int)svEnd._size, svEnd._pData);
+                COUT("%c\n", bObj ? '{' : '[');
             }
-            break;
+            return true;
 
         case TAG::DOUBLE:
-            {
-                /* TODO: add some sort formatting for floats */
-                double f = getDouble(pNode);
-                COUT("%*s", depth, "");
-                COUT("\"%.*s\": %.17lf%.*s", key._size, key._pData, f, svEnd._size, svEnd._pData);
-            }
+            COUT("%*s", depth, "");
+            if (bKey) COUT("\"%.*s\": ", key._size, key._pData);
+            COUT("%.17lf%.*s", getDouble(pNode), svEnd._size, svEnd._pData);
             break;
 
         case TAG::LONG:
-            {
-                long i = getLong(pNode);
-                COUT("%*s", depth, "");
-                COUT("\"%.*s\": %ld%.*s", key._size, key._pData, i, svEnd._size, svEnd._pData);
-            }
+            COUT("%*s", depth, "");
+            if (bKey) COUT("\"%.*s\": ", key._size, key._pData);
+            COUT("%ld%.*s", getLong(pNode), svEnd._size, svEnd._pData);
             break;
 
         case TAG::NULL_:
-                COUT("%*s", depth, "");
-                COUT("\"%.*s\": %s%.*s", key._size, key._pData, "null", svEnd._size, svEnd._pData);
+            COUT("%*s", depth, "");
+            if (bKey) COUT("\"%.*s\": ", key._size, key._pData);
+            COUT("%s%.*s", "null", svEnd._size, svEnd._pData);
             break;
 
         case TAG::STRING:
             {
                 adt::String sl = getString(pNode);
                 COUT("%*s", depth, "");
-                COUT("\"%.*s\": \"%.*s\"%.*s", key._size, key._pData, sl._size, sl._pData, svEnd._size, svEnd._pData);
+                if (bKey) COUT("\"%.*s\": ", key._size, key._pData);
+                COUT("\"%.*s\"%.*s", sl._size, sl._pData, svEnd._size, svEnd._pData);
             }
             break;
 
         case TAG::BOOL:
-            {
-                bool b = getBool(pNode);
-                COUT("%*s", depth, "");
-                COUT("\"%.*s\": %s%.*s", key._size, key._pData, b ? "true" : "false", svEnd._size, svEnd._pData);
-            }
+            COUT("%*s", depth, "");
+            if (bKey) COUT("\"%.*s\": ", key._size, key._pData);
+            COUT("%s%.*s", getBool(pNode) ? "true" : "false", svEnd._size, svEnd._pData);
             break;
     }
+
+    return false;
+}
+
+void
+printNode(Object* pNode, adt::String svEnd, int depth)
+{
+    adt::Array<PrintFrame> aStack(&adt::StdAllocator, 64);
+
+    if (printBegin(pNode, true, svEnd, depth))
+        aStack.push({pNode, 0, svEnd, depth});
+
+    while (!aStack.empty())
+    {
+        PrintFrame& f = aStack.back();
+        auto& aMembers = getObject(f.pNode);
+
+        if (f.i >= aMembers._size)
+        {
+            COUT("%*s", f.depth, "");
+            COUT("%c%.*s", f.pNode->tagVal.tag == TAG::OBJECT ? '}' : ']', f.svEnd._size, f.svEnd._pData);
+            aStack.pop();
+            continue;
+        }
+
+        u32 i = f.i++;
+        Object* pChild = &aMembers[i];
+        adt::String slE = (i == aMembers._size - 1) ? "\n" : ",\n";
+        bool bKey = f.pNode->tagVal.tag == TAG::OBJECT;
+        int childDepth = f.depth + 2;
+
+        /* `f` is invalid after push */
+        if (printBegin(pChild, bKey, slE, childDepth))
+            aStack.push({pChild, 0, slE, childDepth});
+    }
+
+    aStack.destroy();
 }
 
+struct TraverseFrame
+{
+    adt::Array<Object>* pMembers;
+    u32 i;
+};
+
 void
 Parser::traverse(Object* pNode, bool (*pfn)(Object* p, void* args), void* args)
 {
     if (pfn(pNode, args)) return;
+    if (pNode->tagVal.tag != TAG::OBJECT && pNode->tagVal.tag != TAG::ARRAY) return;
 
-    switch (pNode->tagVal.tag)
+    adt::Array<TraverseFrame> aStack(&adt::StdAllocator, 64);
+    aStack.push({&getObject(pNode), 0});
+
+    while (!aStack.empty())
     {
-        default:
-            break;
+        TraverseFrame& f = aStack.back();
 
-        case TAG::ARRAY:
-        case TAG::OBJECT:
-            {
-                auto& obj = getObject(pNode);
+        if (f.i >= f.pMembers->_size)
+        {
+            aStack.pop();
+            continue;
+        }
 
-                for (u32 i = 0; i < obj._size; i++)
-                    traverse(&obj[i], pfn, args);
-            }
-            break;
+        Object* pChild = &(*f.pMembers)[f.i++];
+
+        if (pfn(pChild, args)) continue;
+
+        if (pChild->tagVal.tag == TAG::OBJECT || pChild->tagVal.tag == TAG::ARRAY)
+            aStack.push({&getObject(pChild), 0});
     }
+
+    aStack.destroy();
 }
 
 } /* namespace json */
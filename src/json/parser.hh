@@ -2,10 +2,18 @@
 
 #include "lex.hh"
 #include "ast.hh"
+#include "keys.hh"
+#include "ThreadArenaAllocator.hh"
+#include "ThreadPool.hh"
 
 namespace json
 {
 
+constexpr u32 PARSER_DEFAULT_MAX_DEPTH = 4096;
+constexpr u32 PARSER_PARALLEL_MIN_SIZE = adt::SIZE_1M; /* smaller files are parsed on the calling thread */
+constexpr u32 PARSER_CHUNKS_PER_THREAD = 4; /* more chunks than threads, so uneven records even out */
+constexpr u32 PARSER_CHUNK_BLOCK_SIZE = 4 * adt::SIZE_1M; /* per thread blocks of `parseParallel()` */
+
 void printNode(Object* pNode, adt::String svEnd, int depth);
 
 struct Parser
@@ -13,13 +21,22 @@ struct Parser
     adt::Allocator* _pArena;
     adt::String _sName;
     Object* _pHead;
+    u32 _maxDepth; /* nesting limit, the depth stack is preallocated from `_pArena` on `parse()` */
+    bool _bBigIntsAsStrings = false; /* keep integers that overflow long as their literal instead of DOUBLE */
 
-    Parser(adt::Allocator* p) : _pArena(p), _l(p) {}
+    Parser(adt::Allocator* p, u32 maxDepth = PARSER_DEFAULT_MAX_DEPTH) : _pArena(p), _maxDepth(maxDepth), _l(p) {}
 
     void load(adt::String path);
+    void loadIndexed(adt::String path, adt::MappedFile mapped, adt::Array<u32> aIdx); /* mapped and indexed elsewhere */
+    void loadString(adt::String sData); /* any value at the top, `sData` is referenced by the DOM */
+    void countElements(); /* from the structural index, call after `load()` to size containers exactly */
+    void setElementCounts(adt::Array<u32> aCounts) { _aElemCounts = aCounts; _countI = 0; } /* see index.hh */
     void parse();
+    void parseParallel(adt::ThreadPool* pPool); /* splits top-level array between `pPool` workers, see parser.cc */
     void print();
+    void destroy();
     Object* getHeadObj() { return _pHead; }
+    bool done() const { return _tCurr.type == Token::EOF_; } /* nothing is left after the parsed value */
     void traverse(Object* pNode, bool (*pfn)(Object* p, void* a), void* args);
     void traverse(bool (*pfn)(Object* p, void* a), void* args) { traverse(_pHead, pfn, args); }
 
@@ -27,14 +44,19 @@ private:
     Lexer _l;
     Token _tCurr;
     Token _tNext;
+    adt::Array<u32> _aElemCounts {}; /* member counts in the order containers open, empty if unknown */
+    u32 _countI = 0;
+    adt::ThreadArenaAllocator* _pChunkArena {}; /* `parseParallel()` elements live here until `destroy()` */
 
+    void start();
     void expect(enum Token::TYPE t, adt::String svFile, int line);
     void next();
-    void parseNode(Object* pNode);
+    void parseValue(Object* pNode, adt::Array<Object*>* pStack);
+    u32 nextCount() { return _countI < _aElemCounts._size ? _aElemCounts[_countI++] : adt::SIZE_MIN; }
+    static int parseChunk(void* pArg);
+    Object* pushMember(Object* pParent);
     void parseIdent(TagVal* pTV);
     void parseNumber(TagVal* pTV);
-    void parseObject(Object* pNode);
-    void parseArray(Object* pNode); /* arrays are same as objects */
     void parseNull(TagVal* pTV);
     void parseBool(TagVal* pTV);
 };
@@ -50,6 +72,27 @@ searchObject(adt::Array<Object>& aObj, adt::String svKey)
     return nullptr;
 }
 
+/* Search inside JSON object node. With `pIndexes` objects of `KEY_INDEX_THRESHOLD` members and more are
+ * looked up through a hashed key index, built on first search and kept in `pIndexes`, see `KeyIndexTable`.
+ * Misses fall back to linear search, a found key means the index was stale and it's rebuilt next time. */
+inline Object*
+searchObject(Object* pObj, adt::String svKey, KeyIndexTable* pIndexes = nullptr)
+{
+    assert(pObj->tagVal.tag == TAG::OBJECT);
+    auto& aObj = pObj->tagVal.val.o;
+
+    if (!pIndexes || aObj._size < KEY_INDEX_THRESHOLD)
+        return searchObject(aObj, svKey);
+
+    u32 m = keyIndexFind(pIndexes->get(aObj), aObj, svKey, keyHash(svKey));
+    if (m != adt::NPOS) return &aObj[m];
+
+    Object* pFound = searchObject(aObj, svKey);
+    if (pFound) pIndexes->invalidate(aObj);
+
+    return pFound;
+}
+
 inline adt::Array<Object>&
 getObject(Object* obj)
 {
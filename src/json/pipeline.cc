@@ -0,0 +1,252 @@
+#include <new>
+
+#include "pipeline.hh"
+#include "parser.hh"
+#include "index.hh"
+#include "ArenaAllocator.hh"
+#include "SPSCQueue.hh"
+#include "logs.hh"
+
+namespace json
+{
+
+enum PIPELINE_STEP : u32
+{
+    PIPELINE_READ,
+    PIPELINE_INDEX,
+    PIPELINE_PARSE,
+};
+
+/* one file on its way through the stages, owned by one stage at a time */
+struct PipelineSlot
+{
+    adt::ArenaAllocator arena;
+    adt::String sPath {};
+    u32 fileI {};
+    adt::MappedFile mapped {}; /* moves into `pParser` on parse */
+    adt::Array<u32> aIdx {};
+    adt::Array<u32> aCounts {};
+    Parser* pParser {};
+};
+
+struct PipelineStage;
+
+struct PipelineRun
+{
+    Pipeline* pSelf;
+    const adt::Array<adt::String>* paPaths;
+    PipelineSlot* aSlots;
+    PipelineStage* aStages;
+    adt::TaskGroup group; /* every scheduled stage task */
+    std::atomic<bool> bStop;
+};
+
+/* One step of the pipeline. At most one task per stage is scheduled at a time, so its input queue has a
+ * single consumer and files stay in order. The task runs while there is input and returns when there's none,
+ * the next push to its queue schedules it again. Nothing ever blocks a pool thread. */
+struct PipelineStage
+{
+    PipelineRun* pRun;
+    u32 eStep;
+    adt::SPSCQueue<u32>* pIn;
+    adt::SPSCQueue<u32>* pOut;
+    PipelineStage* pNext; /* null for the last one, the consumer polls its output */
+    u32 nextFileI; /* read stage only */
+    std::atomic<bool> bScheduled;
+};
+
+static void
+step(PipelineRun* pRun, PipelineSlot* pS, u32 eStep)
+{
+    switch (eStep)
+    {
+        case PIPELINE_READ:
+            pS->mapped = adt::mapFile(pS->sPath, adt::MAPPED_SEQUENTIAL | adt::MAPPED_POPULATE);
+            break;
+
+        case PIPELINE_INDEX:
+            pS->aIdx = buildIndex(&pS->arena, pS->mapped.sFile);
+            pS->aCounts = countElements(&pS->arena, pS->mapped.sFile, pS->aIdx);
+            break;
+
+        case PIPELINE_PARSE:
+            pS->pParser = (Parser*)pS->arena.alloc(1, sizeof(Parser));
+            new(pS->pParser) Parser(&pS->arena);
+            pS->pParser->_bBigIntsAsStrings = pRun->pSelf->_bBigIntsAsStrings;
+            pS->pParser->loadIndexed(pS->sPath, pS->mapped, pS->aIdx);
+            pS->mapped = {};
+            pS->pParser->setElementCounts(pS->aCounts);
+            pS->pParser->parse();
+            break;
+    }
+}
+
+static int stageTask(void* pArg);
+
+/* after pushing to `pStage->pIn` */
+static void
+schedule(PipelineStage* pStage)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!pStage->bScheduled.exchange(true, std::memory_order_seq_cst))
+        pStage->pRun->pSelf->_pPool->submit(&pStage->pRun->group, stageTask, pStage);
+}
+
+static int
+stageTask(void* pArg)
+{
+    auto* pStage = (PipelineStage*)pArg;
+    PipelineRun* pRun = pStage->pRun;
+    u32 nFiles = pRun->paPaths->_size;
+
+    while (true)
+    {
+        u32 slotI;
+        while (!pRun->bStop.load(std::memory_order_relaxed) &&
+            (pStage->eStep != PIPELINE_READ || pStage->nextFileI < nFiles) &&
+            pStage->pIn->pop(&slotI))
+        {
+            PipelineSlot* pS = &pRun->aSlots[slotI];
+            if (pStage->eStep == PIPELINE_READ)
+            {
+                pS->sPath = (*pRun->paPaths)[pStage->nextFileI];
+                pS->fileI = pStage->nextFileI++;
+            }
+
+            step(pRun, pS, pStage->eStep);
+
+            /* room for every slot, never fails */
+            pStage->pOut->push(slotI);
+            if (pStage->pNext) schedule(pStage->pNext);
+        }
+
+        /* pairs with `schedule()`: either the producer sees us unscheduled or we see its push */
+        pStage->bScheduled.store(false, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool bMore = !pRun->bStop.load(std::memory_order_relaxed) &&
+            (pStage->eStep != PIPELINE_READ || pStage->nextFileI < nFiles) &&
+            !pStage->pIn->empty();
+
+        if (!bMore || pStage->bScheduled.exchange(true, std::memory_order_seq_cst))
+            break;
+    }
+
+    return 0;
+}
+
+/* parser owns the mapping once it exists, the arena is kept for the next file */
+static void
+recycle(PipelineSlot* pS)
+{
+    if (pS->pParser) pS->pParser->destroy();
+    else adt::unmapFile(&pS->mapped);
+
+    pS->pParser = nullptr;
+    pS->aIdx = {};
+    pS->aCounts = {};
+    pS->arena.reset();
+}
+
+u32
+Pipeline::run(const adt::Array<adt::String>& aPaths, PipelineCallback pfn, void* pArgs)
+{
+    if (aPaths.empty())
+        return 0;
+
+    u32 nSlots = _nInFlight < aPaths._size ? _nInFlight : aPaths._size;
+    u32 nConsumed = 0;
+
+    PipelineRun run {.pSelf = this, .paPaths = &aPaths, .aSlots = nullptr, .aStages = nullptr, .group {}, .bStop {false}};
+    run.aSlots = (PipelineSlot*)_pAlloc->alloc(nSlots, sizeof(PipelineSlot));
+    for (u32 i = 0; i < nSlots; i++)
+        new(&run.aSlots[i]) PipelineSlot {.arena {PIPELINE_ARENA_BLOCK_SIZE}};
+
+    if (!_pPool)
+    {
+        /* no pool, same steps one file at a time */
+        PipelineSlot* pS = &run.aSlots[0];
+        for (u32 i = 0; i < aPaths._size; i++)
+        {
+            pS->sPath = aPaths[i];
+            pS->fileI = i;
+            for (u32 s = PIPELINE_READ; s < PIPELINE_STAGES; s++)
+                step(&run, pS, s);
+
+            nConsumed++;
+            bool bGoOn = pfn(pS->pParser->getHeadObj(), pS->sPath, i, pArgs);
+            recycle(pS);
+            if (!bGoOn) break;
+        }
+    }
+    else
+    {
+        /* queue 0 feeds free slots to the reader, queue `PIPELINE_STAGES` feeds the consumer */
+        adt::SPSCQueue<u32> aQueues[PIPELINE_STAGES + 1];
+        for (u32 i = 0; i <= PIPELINE_STAGES; i++)
+            new(&aQueues[i]) adt::SPSCQueue<u32>(_pAlloc, nSlots);
+
+        PipelineStage aStages[PIPELINE_STAGES];
+        for (u32 i = 0; i < PIPELINE_STAGES; i++)
+        {
+            new(&aStages[i]) PipelineStage {
+                .pRun = &run,
+                .eStep = i,
+                .pIn = &aQueues[i],
+                .pOut = &aQueues[i + 1],
+                .pNext = i + 1 < PIPELINE_STAGES ? &aStages[i + 1] : nullptr,
+                .nextFileI = 0,
+                .bScheduled {false},
+            };
+        }
+        run.aStages = aStages;
+
+        for (u32 i = 0; i < nSlots; i++)
+            aQueues[0].push(i);
+        schedule(&aStages[0]);
+
+        auto& qDone = aQueues[PIPELINE_STAGES];
+        for (u32 i = 0; i < aPaths._size; i++)
+        {
+            /* run stage tasks here when the pool is short of threads, e.g. when `run()` is a task itself */
+            u32 slotI;
+            for (u32 nIdle = 0; !qDone.pop(&slotI); )
+            {
+                if (_pPool->runOne()) nIdle = 0;
+                else if (++nIdle < adt::THREAD_POOL_SPIN_ROUNDS) adt::cpuRelax();
+                else thrd_yield();
+            }
+
+            PipelineSlot* pS = &run.aSlots[slotI];
+            nConsumed++;
+            bool bGoOn = pfn(pS->pParser->getHeadObj(), pS->sPath, pS->fileI, pArgs);
+            recycle(pS);
+
+            if (!bGoOn)
+            {
+                run.bStop.store(true, std::memory_order_relaxed);
+                break;
+            }
+
+            aQueues[0].push(slotI);
+            schedule(&aStages[0]);
+        }
+
+        _pPool->waitFor(&run.group);
+
+        for (u32 i = 0; i <= PIPELINE_STAGES; i++)
+            aQueues[i].destroy();
+    }
+
+    /* whatever a stopped batch left in flight */
+    for (u32 i = 0; i < nSlots; i++)
+    {
+        recycle(&run.aSlots[i]);
+        run.aSlots[i].arena.freeAll();
+    }
+    _pAlloc->free(run.aSlots);
+
+    return nConsumed;
+}
+
+} /* namespace json */
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ast.hh"
+#include "ThreadPool.hh"
+
+namespace json
+{
+
+constexpr u32 PIPELINE_STAGES = 3; /* read, index, parse run on the pool, consuming runs on the caller */
+constexpr u32 PIPELINE_DEFAULT_IN_FLIGHT = 4; /* files between being read and consumed */
+constexpr u32 PIPELINE_ARENA_BLOCK_SIZE = 4 * adt::SIZE_1M; /* per in-flight file: index, counts and DOM */
+
+/* Called for every document in input order, on the thread that called `Pipeline::run()`.
+ * `pRoot` and its strings are only valid during the call. Return false to stop the batch. */
+typedef bool (*PipelineCallback)(Object* pRoot, adt::String sPath, u32 fileI, void* pArgs);
+
+/* Ingest of many files with the stages overlapped: while one file is consumed the next is parsed,
+ * the one after that is indexed and the one after that is read (mapped and prefaulted).
+ * Stages are connected by SPSC queues that carry slot indices. There are `_nInFlight` slots, each with its own
+ * arena, freed slots go back to the reader, so memory is bounded by the biggest files in flight, not by the batch.
+ * Stage tasks never wait: they drain their input and return, a push to an idle stage schedules it. The caller
+ * runs pool tasks while it waits for the next document, so `run()` makes progress on a pool of any size,
+ * including from inside one of the pool's own tasks. Without a pool everything runs on the caller. */
+struct Pipeline
+{
+    adt::Allocator* _pAlloc; /* slots and queues */
+    adt::ThreadPool* _pPool;
+    u32 _nInFlight;
+    bool _bBigIntsAsStrings = false;
+
+    Pipeline(adt::Allocator* p, adt::ThreadPool* pPool, u32 nInFlight = PIPELINE_DEFAULT_IN_FLIGHT)
+        : _pAlloc(p), _pPool(pPool), _nInFlight(nInFlight < 1 ? 1 : nInFlight) {}
+
+    u32 run(const adt::Array<adt::String>& aPaths, PipelineCallback pfn, void* pArgs); /* returns number of documents consumed */
+};
+
+} /* namespace json */
@@ -0,0 +1,226 @@
+#include "tape.hh"
+#include "number.hh"
+#include "writer.hh"
+#include "logs.hh"
+
+namespace json
+{
+
+struct TapeFrame
+{
+    u32 begin; /* index of the begin word */
+    u32 count;
+};
+
+void
+Tape::load(adt::String path)
+{
+    _sName = path;
+    _l.loadFile(path);
+    next();
+
+    if ((_tCurr.type != Token::LBRACE) && (_tCurr.type != Token::LBRACKET))
+    {
+        CERR("wrong first token\n");
+        exit(2);
+    }
+}
+
+void
+Tape::expect(enum Token::TYPE t, int line)
+{
+    if (_tCurr.type != t)
+    {
+        CERR("('%s', at %d): (%.*s): unexpected token: expected: '%c', got '%c'\n",
+             __FILE__, line, _sName._size, _sName._pData, char(t), char(_tCurr.type));
+        exit(2);
+    }
+}
+
+void
+Tape::pushString(adt::String s)
+{
+    u32 off = _aStrings._size;
+    u32 size = s._size;
+    u32 need = off + sizeof(size) + size + 1;
+
+    if (need > _aStrings._capacity)
+        _aStrings.grow(need > _aStrings._capacity * 2 ? need : _aStrings._capacity * 2);
+
+    char* p = &_aStrings[off];
+    memcpy(p, &size, sizeof(size));
+    memcpy(p + sizeof(size), s._pData, size);
+    p[sizeof(size) + size] = '\0';
+    _aStrings._size = need;
+
+    push(TAPE::STRING, off);
+}
+
+void
+Tape::pushNumber()
+{
+    Number num = toNumber(_tCurr.svLiteral);
+
+    switch (num.eType)
+    {
+        case Number::LONG:
+            push(TAPE::LONG, 0);
+            _aTape.push(u64(num.l));
+            break;
+
+        case Number::BIG_INT:
+        case Number::DOUBLE:
+            {
+                u64 bits;
+                memcpy(&bits, &num.d, sizeof(bits));
+                push(TAPE::DOUBLE, 0);
+                _aTape.push(bits);
+            }
+            break;
+
+        case Number::INVALID:
+            CERR("(%.*s): invalid number: '%.*s'\n",
+                 _sName._size, _sName._pData, _tCurr.svLiteral._size, _tCurr.svLiteral._pData);
+            exit(2);
+    }
+}
+
+/* Exact word count from the structural index: `,` and `:` take none, strings (2 entries, both quotes) and
+ * everything else one, numbers two, plus both roots. */
+static u32
+countWords(adt::String sFile, const adt::Array<u32>& aIdx)
+{
+    u32 n = 2;
+    for (u32 i = 0; i < aIdx._size; i++)
+    {
+        char c = sFile[aIdx[i]];
+
+        if (c == ',' || c == ':') continue;
+        else if (c == '"') i++; /* closing quote */
+        else if (c == '-' || (c >= '0' && c <= '9')) n++;
+
+        n++;
+    }
+
+    return n;
+}
+
+void
+Tape::parse()
+{
+    _aTape = adt::Array<u64>(_pAlloc, countWords(_l._sFile, _l._aIdx));
+    _aStrings = adt::Array<char>(_pAlloc, _l._sFile._size + 1);
+    adt::Array<TapeFrame> aStack(_pAlloc, 64);
+
+    push(TAPE::ROOT, 0);
+
+    for (;;)
+    {
+        /* value */
+        switch (_tCurr.type)
+        {
+            default:
+                CERR("('%s', at %d): (%.*s): unexpected token: '%c'\n",
+                     __FILE__, __LINE__, _sName._size, _sName._pData, char(_tCurr.type));
+                exit(2);
+
+            case Token::LBRACE:
+            case Token::LBRACKET:
+                {
+                    bool bObj = _tCurr.type == Token::LBRACE;
+                    aStack.push({_aTape._size, 0});
+                    push(bObj ? TAPE::OBJECT_BEGIN : TAPE::ARRAY_BEGIN, 0);
+                    next();
+
+                    if (_tCurr.type == (bObj ? Token::RBRACE : Token::RBRACKET))
+                        break;
+
+                    aStack.back().count++;
+                    if (bObj)
+                    {
+                        expect(Token::IDENT, __LINE__);
+                        pushString(_tCurr.svLiteral);
+                        next();
+                        expect(Token::ASSIGN, __LINE__);
+                        next();
+                    }
+                }
+                continue;
+
+            case Token::IDENT:
+                pushString(_tCurr.svLiteral);
+                next();
+                break;
+
+            case Token::NUMBER:
+                pushNumber();
+                next();
+                break;
+
+            case Token::TRUE_:
+                push(TAPE::TRUE_, 0);
+                next();
+                break;
+
+            case Token::FALSE_:
+                push(TAPE::FALSE_, 0);
+                next();
+                break;
+
+            case Token::NULL_:
+                push(TAPE::NULL_, 0);
+                next();
+                break;
+        }
+
+        /* close finished containers, stop at the next element */
+        while (!aStack.empty())
+        {
+            TapeFrame& f = aStack.back();
+            bool bObj = tag(f.begin) == TAPE::OBJECT_BEGIN;
+
+            if (_tCurr.type == Token::COMMA)
+            {
+                next();
+                f.count++;
+                if (bObj)
+                {
+                    expect(Token::IDENT, __LINE__);
+                    pushString(_tCurr.svLiteral);
+                    next();
+                    expect(Token::ASSIGN, __LINE__);
+                    next();
+                }
+                break;
+            }
+
+            expect(bObj ? Token::RBRACE : Token::RBRACKET, __LINE__);
+
+            u32 count = f.count < TAPE_COUNT_MAX ? f.count : TAPE_COUNT_MAX;
+            _aTape[f.begin] |= (u64(count) << 32) | (_aTape._size + 1);
+            push(bObj ? TAPE::OBJECT_END : TAPE::ARRAY_END, f.begin);
+            aStack.pop();
+            next();
+        }
+
+        if (aStack.empty())
+            break;
+    }
+
+    _aTape[0] |= _aTape._size;
+    push(TAPE::ROOT, 0);
+
+    aStack.destroy();
+}
+
+void
+Tape::print()
+{
+    Writer w(_pAlloc, true, sinkFILE, stdout);
+    w.write(getRoot());
+    w.flush();
+    w.destroy();
+    COUT("\n");
+}
+
+} /* namespace json */
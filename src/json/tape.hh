@@ -0,0 +1,229 @@
+#pragma once
+
+#include <string.h>
+
+#include "lex.hh"
+
+namespace json
+{
+
+/* Compact DOM: one contiguous array of u64 words, top 8 bits are the tag, low 56 bits the payload.
+ * `{` / `[`: low 32 bits index one past the matching end word, next 24 bits element count (saturated).
+ * `}` / `]`: index of the matching begin word.
+ * `"`: offset into string buffer, which holds u32 length, the bytes and '\0'. Object keys are `"` words too.
+ * `l` / `d`: value is the raw bits of the next word.
+ * `t`, `f`, `n`: no payload.
+ * `r`: first and last word of the tape, point at each other. */
+enum class TAPE : u8
+{
+    ROOT = 'r',
+    OBJECT_BEGIN = '{',
+    OBJECT_END = '}',
+    ARRAY_BEGIN = '[',
+    ARRAY_END = ']',
+    STRING = '"',
+    LONG = 'l',
+    DOUBLE = 'd',
+    TRUE_ = 't',
+    FALSE_ = 'f',
+    NULL_ = 'n'
+};
+
+constexpr u64 TAPE_PAYLOAD_MASK = (1ULL << 56) - 1;
+constexpr u32 TAPE_COUNT_MAX = (1U << 24) - 1;
+
+struct Tape;
+
+/* handle to the first word of a value */
+struct TapeRef
+{
+    const Tape* pTape;
+    u32 i;
+
+    bool valid() const { return i != adt::NPOS; }
+};
+
+struct Tape
+{
+    adt::Allocator* _pAlloc;
+    adt::String _sName;
+    adt::Array<u64> _aTape;
+    adt::Array<char> _aStrings;
+
+    Tape(adt::Allocator* p) : _pAlloc(p), _l(p) {}
+
+    void load(adt::String path);
+    void parse();
+    void print(); /* pretty, like `Parser::print()` */
+    void destroy();
+    TapeRef getRoot() const { return {this, 1}; }
+
+    TAPE tag(u32 i) const { return TAPE(_aTape[i] >> 56); }
+    u64 payload(u32 i) const { return _aTape[i] & TAPE_PAYLOAD_MASK; }
+    u32 skip(u32 i) const; /* index of the value after `i` */
+
+private:
+    Lexer _l;
+    Token _tCurr;
+
+    void next() { _tCurr = _l.next(); }
+    void expect(enum Token::TYPE t, int line);
+    void push(TAPE eTag, u64 payload) { _aTape.push((u64(eTag) << 56) | payload); }
+    void pushString(adt::String s);
+    void pushNumber();
+};
+
+/* owns the tape, the strings and the index `load()` built */
+inline void
+Tape::destroy()
+{
+    if (_aTape._pAlloc) _aTape.destroy();
+    if (_aStrings._pAlloc) _aStrings.destroy();
+    if (_l._aIdx._pAlloc) _l._aIdx.destroy();
+    _aTape = {};
+    _aStrings = {};
+    _l._aIdx = {};
+    _l.destroy();
+}
+
+inline u32
+Tape::skip(u32 i) const
+{
+    switch (tag(i))
+    {
+        default:
+            return i + 1;
+
+        case TAPE::OBJECT_BEGIN:
+        case TAPE::ARRAY_BEGIN:
+            return u32(payload(i));
+
+        case TAPE::LONG:
+        case TAPE::DOUBLE:
+            return i + 2;
+    }
+}
+
+struct TapeField
+{
+    adt::String svKey;
+    TapeRef val;
+};
+
+struct TapeArray
+{
+    const Tape* _pTape;
+    u32 _begin; /* index of `[` */
+
+    u32 size() const { return u32(_pTape->payload(_begin) >> 32) & TAPE_COUNT_MAX; }
+    bool empty() const { return _pTape->tag(_begin + 1) == TAPE::ARRAY_END; }
+
+    struct It
+    {
+        const Tape* _pTape;
+        u32 _i;
+
+        TapeRef operator*() const { return {_pTape, _i}; }
+        It operator++() { _i = _pTape->skip(_i); return *this; }
+        friend bool operator==(const It& l, const It& r) { return l._i == r._i; }
+        friend bool operator!=(const It& l, const It& r) { return l._i != r._i; }
+    };
+
+    It begin() const { return {_pTape, _begin + 1}; }
+    It end() const { return {_pTape, u32(_pTape->payload(_begin)) - 1}; }
+};
+
+struct TapeObject
+{
+    const Tape* _pTape;
+    u32 _begin; /* index of `{` */
+
+    u32 size() const { return u32(_pTape->payload(_begin) >> 32) & TAPE_COUNT_MAX; }
+    bool empty() const { return _pTape->tag(_begin + 1) == TAPE::OBJECT_END; }
+
+    struct It
+    {
+        const Tape* _pTape;
+        u32 _i; /* key word */
+
+        TapeField operator*() const;
+        It operator++() { _i = _pTape->skip(_i + 1); return *this; }
+        friend bool operator==(const It& l, const It& r) { return l._i == r._i; }
+        friend bool operator!=(const It& l, const It& r) { return l._i != r._i; }
+    };
+
+    It begin() const { return {_pTape, _begin + 1}; }
+    It end() const { return {_pTape, u32(_pTape->payload(_begin)) - 1}; }
+};
+
+inline TAPE
+getTag(TapeRef r)
+{
+    return r.pTape->tag(r.i);
+}
+
+inline TapeObject
+getObject(TapeRef r)
+{
+    assert(getTag(r) == TAPE::OBJECT_BEGIN);
+    return {r.pTape, r.i};
+}
+
+inline TapeArray
+getArray(TapeRef r)
+{
+    assert(getTag(r) == TAPE::ARRAY_BEGIN);
+    return {r.pTape, r.i};
+}
+
+inline long
+getLong(TapeRef r)
+{
+    assert(getTag(r) == TAPE::LONG);
+    return long(r.pTape->_aTape[r.i + 1]);
+}
+
+inline double
+getDouble(TapeRef r)
+{
+    assert(getTag(r) == TAPE::DOUBLE);
+    u64 bits = r.pTape->_aTape[r.i + 1];
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+inline adt::String
+getString(TapeRef r)
+{
+    assert(getTag(r) == TAPE::STRING);
+    const char* p = &r.pTape->_aStrings[u32(r.pTape->payload(r.i))];
+    u32 size;
+    memcpy(&size, p, sizeof(size));
+    return {const_cast<char*>(p + sizeof(size)), size};
+}
+
+inline bool
+getBool(TapeRef r)
+{
+    return getTag(r) == TAPE::TRUE_;
+}
+
+inline TapeField
+TapeObject::It::operator*() const
+{
+    return {getString({_pTape, _i}), {_pTape, _i + 1}};
+}
+
+/* Linear search inside tape object. Returns invalid ref if not found */
+inline TapeRef
+searchObject(TapeObject obj, adt::String svKey)
+{
+    for (auto f : obj)
+        if (f.svKey == svKey)
+            return f.val;
+
+    return {obj._pTape, adt::NPOS};
+}
+
+} /* namespace json */
@@ -0,0 +1,287 @@
+#include <stdio.h>
+
+#include "writer.hh"
+#include "parser.hh"
+#include "tape.hh"
+#include "number.hh"
+#include "DefaultAllocator.hh"
+
+namespace json
+{
+
+/* 0: as is, 'u': \u00XX, other: \<char> */
+static const char ESCAPE_LUT[256] {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+struct WriteFrame
+{
+    Object* pNode;
+    u32 i;
+};
+
+void
+sinkFILE(void* pCtx, const char* pData, u32 size)
+{
+    fwrite(pData, 1, size, (FILE*)pCtx);
+}
+
+void
+Writer::flush()
+{
+    if (_pfnSink && _aBuff._size > 0)
+    {
+        _pfnSink(_pSinkCtx, _aBuff._pData, _aBuff._size);
+        _aBuff._size = 0;
+    }
+}
+
+char*
+Writer::reserve(u32 size)
+{
+    if (_aBuff._size + size > _aBuff._capacity)
+    {
+        flush();
+
+        if (_aBuff._size + size > _aBuff._capacity)
+        {
+            u32 cap = _aBuff._capacity * 2;
+            while (cap < _aBuff._size + size) cap *= 2;
+            _aBuff.grow(cap);
+        }
+    }
+
+    return &_aBuff[_aBuff._size];
+}
+
+void
+Writer::putString(adt::String s, bool bRaw)
+{
+    put('"');
+
+    u32 start = 0;
+    for (u32 i = 0; i < s._size; i++)
+    {
+        u8 c = s[i];
+        char e = ESCAPE_LUT[c];
+
+        if (!e || (bRaw && c >= 0x20))
+            continue;
+
+        put(&s[start], i - start);
+        start = i + 1;
+
+        if (e == 'u')
+        {
+            char aU[] = "\\u00XX";
+            aU[4] = "0123456789abcdef"[c >> 4];
+            aU[5] = "0123456789abcdef"[c & 0xF];
+            put(aU, 6);
+        }
+        else
+        {
+            char aE[] {'\\', e};
+            put(aE, 2);
+        }
+    }
+
+    put(&s[start], s._size - start);
+    put('"');
+}
+
+void
+Writer::putIndent(int depth)
+{
+    u32 n = 1 + depth * 2;
+    char* p = reserve(n);
+    p[0] = '\n';
+    memset(p + 1, ' ', n - 1);
+    _aBuff._size += n;
+}
+
+void
+Writer::putScalar(Object* pNode)
+{
+    switch (pNode->tagVal.tag)
+    {
+        default:
+            break;
+
+        case TAG::NULL_:
+            put("null", 4);
+            break;
+
+        case TAG::STRING:
+            putString(json::getString(pNode), pNode->tagVal.eRaw & RAW_STRING);
+            break;
+
+        case TAG::LONG:
+            _aBuff._size += formatLong(getLong(pNode), reserve(24));
+            break;
+
+        case TAG::DOUBLE:
+            _aBuff._size += formatDouble(getDouble(pNode), reserve(32));
+            break;
+
+        case TAG::BOOL:
+            if (getBool(pNode)) put("true", 4);
+            else put("false", 5);
+            break;
+    }
+}
+
+void
+Writer::write(Object* pNode)
+{
+    if (pNode->tagVal.tag != TAG::OBJECT && pNode->tagVal.tag != TAG::ARRAY)
+    {
+        putScalar(pNode);
+        return;
+    }
+
+    adt::Array<WriteFrame> aStack(&adt::StdAllocator, 64);
+    put(pNode->tagVal.tag == TAG::OBJECT ? '{' : '[');
+    aStack.push({pNode, 0});
+
+    while (!aStack.empty())
+    {
+        WriteFrame& f = aStack.back();
+        auto& aMembers = getObject(f.pNode);
+        bool bObj = f.pNode->tagVal.tag == TAG::OBJECT;
+        int depth = aStack._size;
+
+        if (f.i >= aMembers._size)
+        {
+            if (_bPretty && !aMembers.empty()) putIndent(depth - 1);
+            put(bObj ? '}' : ']');
+            aStack.pop();
+            continue;
+        }
+
+        Object* pChild = &aMembers[f.i];
+        if (f.i++ > 0) put(',');
+        if (_bPretty) putIndent(depth);
+
+        if (bObj)
+        {
+            putString(pChild->svKey, pChild->tagVal.eRaw & RAW_KEY);
+            if (_bPretty) put(": ", 2);
+            else put(':');
+        }
+
+        /* `f` is invalid after push */
+        if (pChild->tagVal.tag == TAG::OBJECT || pChild->tagVal.tag == TAG::ARRAY)
+        {
+            put(pChild->tagVal.tag == TAG::OBJECT ? '{' : '[');
+            aStack.push({pChild, 0});
+        }
+        else
+        {
+            putScalar(pChild);
+        }
+    }
+
+    aStack.destroy();
+}
+
+void
+Writer::putScalar(const Tape* pTape, u32 i)
+{
+    switch (pTape->tag(i))
+    {
+        default:
+            break;
+
+        case TAPE::NULL_:
+            put("null", 4);
+            break;
+
+        case TAPE::STRING:
+            putString(json::getString(TapeRef {pTape, i}), true);
+            break;
+
+        case TAPE::LONG:
+            _aBuff._size += formatLong(json::getLong(TapeRef {pTape, i}), reserve(24));
+            break;
+
+        case TAPE::DOUBLE:
+            _aBuff._size += formatDouble(json::getDouble(TapeRef {pTape, i}), reserve(32));
+            break;
+
+        case TAPE::TRUE_:
+            put("true", 4);
+            break;
+
+        case TAPE::FALSE_:
+            put("false", 5);
+            break;
+    }
+}
+
+/* Tape is already in document order, so this is one pass over the words. The stack only holds begin words
+ * of the open containers. */
+void
+Writer::write(TapeRef r)
+{
+    const Tape* pTape = r.pTape;
+    TAPE eTag = pTape->tag(r.i);
+
+    if (eTag != TAPE::OBJECT_BEGIN && eTag != TAPE::ARRAY_BEGIN)
+    {
+        putScalar(pTape, r.i);
+        return;
+    }
+
+    adt::Array<u32> aStack(&adt::StdAllocator, 64);
+    put(char(eTag));
+    aStack.push(r.i);
+    u32 i = r.i + 1;
+
+    while (!aStack.empty())
+    {
+        u32 begin = aStack.back();
+        bool bObj = pTape->tag(begin) == TAPE::OBJECT_BEGIN;
+        int depth = aStack._size;
+        eTag = pTape->tag(i);
+
+        if (eTag == TAPE::OBJECT_END || eTag == TAPE::ARRAY_END)
+        {
+            if (_bPretty && i != begin + 1) putIndent(depth - 1);
+            put(char(eTag));
+            aStack.pop();
+            i++;
+            continue;
+        }
+
+        if (i != begin + 1) put(',');
+        if (_bPretty) putIndent(depth);
+
+        if (bObj)
+        {
+            putString(json::getString(TapeRef {pTape, i}), true);
+            if (_bPretty) put(": ", 2);
+            else put(':');
+            eTag = pTape->tag(++i);
+        }
+
+        if (eTag == TAPE::OBJECT_BEGIN || eTag == TAPE::ARRAY_BEGIN)
+        {
+            put(char(eTag));
+            aStack.push(i++);
+        }
+        else
+        {
+            putScalar(pTape, i);
+            i = pTape->skip(i);
+        }
+    }
+
+    aStack.destroy();
+}
+
+} /* namespace json */
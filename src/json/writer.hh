@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string.h>
+
+#include "ast.hh"
+
+namespace json
+{
+
+/* receives full buffers from `Writer` */
+typedef void (*WriterSink)(void* pCtx, const char* pData, u32 size);
+
+/* `pCtx` is `FILE*` */
+void sinkFILE(void* pCtx, const char* pData, u32 size);
+
+constexpr u32 WRITER_FLUSH_SIZE = 64 * adt::SIZE_1K;
+
+struct Tape;
+struct TapeRef;
+
+/* Serializes DOM into a buffer, minified or pretty with 2 space indentation.
+ * Parsed strings keep their source escapes and are written as they are, strings from `putString()` etc. are plain
+ * text and fully escaped, see `TagVal::eRaw`. Both kinds can be mixed in one DOM.
+ * Without sink the buffer grows and holds the whole document, see `getString()`.
+ * With sink it's flushed in `WRITER_FLUSH_SIZE` chunks. */
+struct Writer
+{
+    adt::Array<char> _aBuff;
+    WriterSink _pfnSink {};
+    void* _pSinkCtx {};
+    bool _bPretty {};
+
+    Writer(adt::Allocator* p, bool bPretty) : _aBuff(p, adt::SIZE_8K), _bPretty(bPretty) {}
+    Writer(adt::Allocator* p, bool bPretty, WriterSink pfnSink, void* pCtx)
+        : _aBuff(p, WRITER_FLUSH_SIZE), _pfnSink(pfnSink), _pSinkCtx(pCtx), _bPretty(bPretty) {}
+
+    void write(Object* pNode); /* `pNode`'s own key is not written */
+    void write(TapeRef r); /* same output as the DOM of the same file */
+    void flush();
+    adt::String getString() { return {_aBuff._pData, _aBuff._size}; }
+    void destroy() { _aBuff.destroy(); }
+
+private:
+    char* reserve(u32 size);
+    void put(const char* pData, u32 size) { memcpy(reserve(size), pData, size); _aBuff._size += size; }
+    void put(char c) { *reserve(1) = c; _aBuff._size++; }
+    void putString(adt::String s, bool bRaw); /* raw strings only get control characters escaped */
+    void putIndent(int depth);
+    void putScalar(Object* pNode);
+    void putScalar(const Tape* pTape, u32 i);
+};
+
+} /* namespace json */
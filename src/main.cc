@@ -1,19 +1,35 @@
 #include "logs.hh"
 #include "json/parser.hh"
+#include "json/writer.hh"
+#include "json/ndjson.hh"
+#include "json/pipeline.hh"
+#include "json/tape.hh"
 #include "ArenaAllocator.hh"
+#include "DefaultAllocator.hh"
+#include "PoolAllocator.hh"
 
 int
 main(int argCount, char* paArgs[])
 {
-    adt::ArenaAllocator alloc(adt::SIZE_1M * 50);
+    adt::ArenaAllocator alloc(adt::SIZE_1M * 50, adt::ARENA_HUGE_PAGES);
+    adt::PoolAllocator pool;
 
     if (argCount < 1)
     {
         COUT("jsonast version: %f\n\n", JSONASTCPP_VERSION);
-        COUT("usage: %s <path to json> [-p(print)|-e(json creation example)]\n", paArgs[0]);
+        COUT("usage: %s <path to json> [-p(print)|-P(parse top-level array on all cores and print)|-t(parse into tape and print)|-l(json lines: print each record on its own line)|-e(json creation example)] [pool(DOM in size-class pool instead of arena)] [-s(allocator stats to stderr)]\n", paArgs[0]);
+        COUT("       %s -m <path to json>... (read, index and parse files in a pipeline, print each document on its own line)\n", paArgs[0]);
         exit(3);
     }
 
+    bool bStats = false;
+    for (int i = 2; i < argCount; i++)
+        if (adt::String(paArgs[i]) == "-s") bStats = true;
+
+    adt::Allocator* pDomAlloc = &alloc;
+    if (argCount >= 4 && adt::String(paArgs[3]) == "pool")
+        pDomAlloc = &pool;
+
     if (argCount >= 2 && adt::String(paArgs[1]) == "-e")
     {
         json::Object oHead = json::putObject({}, &alloc);
@@ -32,17 +48,96 @@ main(int argCount, char* paArgs[])
         json::pushToArray(pArr0, json::putDouble({}, -4.4));
         json::pushToArray(pArr0, json::putDouble({}, -5.5));
 
-        json::printNode(&oHead, {}, 0);
+        json::Writer w(&alloc, true, json::sinkFILE, stdout);
+        w.write(&oHead);
+        w.flush();
+        w.destroy();
         COUT("\n");
     }
 
+    if (argCount >= 3 && adt::String(paArgs[1]) == "-m")
+    {
+        adt::Array<adt::String> aPaths(&adt::StdAllocator, argCount);
+        for (int i = 2; i < argCount; i++)
+            if (adt::String(paArgs[i]) != "-s") aPaths.push(paArgs[i]);
+
+        adt::ThreadPool tp(&adt::StdAllocator);
+        tp.start();
+
+        json::Writer w(&alloc, false, json::sinkFILE, stdout);
+        json::Pipeline pl(&adt::StdAllocator, &tp);
+        pl.run(aPaths, [](json::Object* pRoot, adt::String, u32, void* pArgs) -> bool {
+            auto* pW = (json::Writer*)pArgs;
+            pW->write(pRoot);
+            pW->flush();
+            fputc('\n', stdout);
+            return true;
+        }, &w);
+
+        w.destroy();
+        tp.destroy();
+        aPaths.destroy();
+    }
+
     if (argCount >= 3 && adt::String(paArgs[2]) == "-p")
     {
-        json::Parser p(&alloc);
+        json::Parser p(pDomAlloc);
         p.load(paArgs[1]);
+        p.countElements();
         p.parse();
         p.print();
+        p.destroy();
+    }
+
+    if (argCount >= 3 && adt::String(paArgs[2]) == "-P")
+    {
+        adt::ThreadPool tp(&adt::StdAllocator);
+        tp.start();
+
+        json::Parser p(pDomAlloc);
+        p.load(paArgs[1]);
+        p.countElements();
+        p.parseParallel(&tp);
+        p.print();
+        p.destroy();
+
+        tp.destroy();
+    }
+
+    if (argCount >= 3 && adt::String(paArgs[2]) == "-t")
+    {
+        json::Tape t(pDomAlloc);
+        t.load(paArgs[1]);
+        t.parse();
+        t.print();
+        t.destroy();
     }
 
+    if (argCount >= 3 && adt::String(paArgs[2]) == "-l")
+    {
+        json::Writer w(&alloc, false, json::sinkFILE, stdout);
+        adt::ArenaAllocator aRecord(adt::SIZE_1M);
+
+        json::NdjsonReader r(&adt::StdAllocator);
+        r.read(paArgs[1], &aRecord, [](json::Object* pRecord, u64, void* pArgs) -> bool {
+            auto* pW = (json::Writer*)pArgs;
+            pW->write(pRecord);
+            pW->flush();
+            fputc('\n', stdout);
+            return true;
+        }, &w);
+
+        ADT_STATS(if (bStats) aRecord._stats.print(stderr, "record arena");)
+        aRecord.freeAll();
+        w.destroy();
+    }
+
+#ifdef ADT_ALLOCATOR_STATS
+    if (bStats) alloc._stats.print(stderr, "main arena");
+#else
+    if (bStats) CERR("allocator stats are compiled out, build with -DJSONASTCPP_ALLOCATOR_STATS=ON\n");
+#endif
+
+    pool.freeAll();
     alloc.freeAll();
 }
@@ -0,0 +1,97 @@
+/* ArenaAllocator mark/rollback around memory allocated before the mark. */
+
+#include <string.h>
+
+#include "ArenaAllocator.hh"
+#include "logs.hh"
+
+static int s_nFailed = 0;
+
+#define CHECK(C)                                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(C))                                                                                                      \
+        {                                                                                                              \
+            CERR("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #C);                                                \
+            s_nFailed++;                                                                                               \
+        }                                                                                                              \
+    } while (0)
+
+/* last allocation before the mark is grown inside the scope */
+static void
+testGrowAcrossMark()
+{
+    adt::ArenaAllocator arena(adt::SIZE_1K * 64);
+    u32* pKeep = (u32*)arena.alloc(64, sizeof(u32));
+    for (u32 i = 0; i < 64; i++) pKeep[i] = i;
+
+    {
+        adt::ArenaScope scope(&arena);
+
+        /* copied into the scope, never stretched over the mark */
+        u32* pGrown = (u32*)arena.realloc(pKeep, 1024 * sizeof(u32));
+        CHECK(pGrown != pKeep);
+        CHECK(pGrown[63] == 63);
+    }
+
+    /* memory handed out after the rollback must not overlap what was there before the mark */
+    u8* p = (u8*)arena.alloc(1, 8192);
+    memset(p, 0xff, 8192);
+    CHECK(p >= (u8*)(pKeep + 64) || p + 8192 <= (u8*)pKeep);
+
+    bool bIntact = true;
+    for (u32 i = 0; i < 64; i++)
+        if (pKeep[i] != i) bIntact = false;
+    CHECK(bIntact);
+
+    arena.freeAll();
+}
+
+/* freeing the last allocation before the mark can't move the position under it */
+static void
+testFreeAcrossMark()
+{
+    adt::ArenaAllocator arena(adt::SIZE_1K * 64);
+    u32* pKeep = (u32*)arena.alloc(64, sizeof(u32));
+    for (u32 i = 0; i < 64; i++) pKeep[i] = i;
+
+    adt::ArenaMark m = arena.mark();
+    arena.free(pKeep);
+    u32* pNew = (u32*)arena.alloc(64, sizeof(u32));
+    CHECK(pNew != pKeep);
+    arena.rollback(m);
+
+    bool bIntact = true;
+    for (u32 i = 0; i < 64; i++)
+        if (pKeep[i] != i) bIntact = false;
+    CHECK(bIntact);
+
+    arena.freeAll();
+}
+
+/* allocations inside the scope still grow in place */
+static void
+testGrowInsideScope()
+{
+    adt::ArenaAllocator arena(adt::SIZE_1K * 64);
+    arena.alloc(1, 16);
+
+    {
+        adt::ArenaScope scope(&arena);
+        void* p = arena.alloc(1, 64);
+        CHECK(arena.realloc(p, 256) == p);
+    }
+
+    arena.freeAll();
+}
+
+int
+main()
+{
+    testGrowAcrossMark();
+    testFreeAcrossMark();
+    testGrowInsideScope();
+
+    if (s_nFailed) CERR("arena: %d checks failed\n", s_nFailed);
+    return s_nFailed != 0;
+}
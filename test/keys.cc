@@ -0,0 +1,162 @@
+/* KeyIndexTable lookups through searchObject() against linear search. */
+
+#include <stdio.h>
+
+#include "json/parser.hh"
+#include "PoolAllocator.hh"
+#include "logs.hh"
+
+static int s_nFailed = 0;
+
+#define CHECK(C)                                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(C))                                                                                                      \
+        {                                                                                                              \
+            CERR("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #C);                                                \
+            s_nFailed++;                                                                                               \
+        }                                                                                                              \
+    } while (0)
+
+static char s_aKeys[256][8];
+
+static adt::String
+key(u32 i)
+{
+    snprintf(s_aKeys[i], sizeof(s_aKeys[i]), "k%u", i);
+    return adt::String(s_aKeys[i]);
+}
+
+static json::Object
+makeObject(adt::Allocator* pAlloc, u32 nMembers, u32 firstKey = 0)
+{
+    json::Object o = json::putObject({}, pAlloc);
+    for (u32 i = 0; i < nMembers; i++)
+        json::pushToObject(&o, json::putLong(key(firstKey + i), firstKey + i));
+
+    return o;
+}
+
+/* every key linearly and through the index gives the same member */
+static bool
+agrees(json::Object* pObj, json::KeyIndexTable* pIdx, u32 nKeys)
+{
+    for (u32 i = 0; i < nKeys; i++)
+        if (json::searchObject(pObj, key(i), pIdx) != json::searchObject(json::getObject(pObj), key(i)))
+            return false;
+
+    return true;
+}
+
+static void
+testLookup(adt::Allocator* pAlloc)
+{
+    json::KeyIndexTable idx(pAlloc);
+    json::Object o = makeObject(pAlloc, 100);
+
+    CHECK(agrees(&o, &idx, 100));
+    CHECK(json::getLong(json::searchObject(&o, key(57), &idx)) == 57);
+    CHECK(json::searchObject(&o, "missing", &idx) == nullptr);
+
+    /* below the threshold the table is not used */
+    json::Object small = makeObject(pAlloc, json::KEY_INDEX_THRESHOLD - 1);
+    CHECK(agrees(&small, &idx, json::KEY_INDEX_THRESHOLD - 1));
+    CHECK(idx._map.size() == 1);
+
+    idx.destroy();
+}
+
+static void
+testDuplicates(adt::Allocator* pAlloc)
+{
+    json::KeyIndexTable idx(pAlloc);
+    json::Object o = makeObject(pAlloc, 40);
+    json::pushToObject(&o, json::putLong(key(5), -1));
+    json::pushToObject(&o, json::putLong(key(5), -2));
+
+    /* first one wins, like linear search */
+    CHECK(json::getLong(json::searchObject(&o, key(5), &idx)) == 5);
+    CHECK(agrees(&o, &idx, 40));
+
+    idx.destroy();
+}
+
+static void
+testPushAfterIndex(adt::Allocator* pAlloc)
+{
+    json::KeyIndexTable idx(pAlloc);
+    json::Object o = makeObject(pAlloc, 20);
+    CHECK(agrees(&o, &idx, 20));
+
+    /* grows the member buffer several times */
+    for (u32 i = 20; i < 200; i++)
+        json::pushToObject(&o, json::putLong(key(i), i));
+
+    CHECK(agrees(&o, &idx, 200));
+    CHECK(json::getLong(json::searchObject(&o, key(199), &idx)) == 199);
+
+    idx.destroy();
+}
+
+static void
+testShrink(adt::Allocator* pAlloc)
+{
+    json::KeyIndexTable idx(pAlloc);
+    json::Object o = makeObject(pAlloc, 40);
+    CHECK(agrees(&o, &idx, 40));
+
+    json::getObject(&o)._size = 17;
+    CHECK(json::searchObject(&o, key(19), &idx) == nullptr);
+    CHECK(json::searchObject(&o, key(39), &idx) == nullptr);
+    CHECK(agrees(&o, &idx, 40));
+
+    /* shrink and push different keys back to the old size */
+    json::getObject(&o)._size = 10;
+    for (u32 i = 0; i < 30; i++)
+        json::pushToObject(&o, json::putLong(key(100 + i), 100 + i));
+
+    CHECK(agrees(&o, &idx, 40));
+    CHECK(json::getLong(json::searchObject(&o, key(129), &idx)) == 129);
+
+    idx.destroy();
+}
+
+static void
+testStale(adt::Allocator* pAlloc)
+{
+    json::KeyIndexTable idx(pAlloc);
+    json::Object a = makeObject(pAlloc, 32);
+    CHECK(agrees(&a, &idx, 32));
+
+    /* pool hands the same slot to the next object of the same size class */
+    void* pOld = json::getObject(&a)._pData;
+    json::getObject(&a).destroy();
+    json::Object b = makeObject(pAlloc, 32, 200);
+    CHECK(json::getObject(&b)._pData == pOld);
+    CHECK(json::getLong(json::searchObject(&b, key(231), &idx)) == 231);
+    CHECK(json::searchObject(&b, key(0), &idx) == nullptr);
+
+    /* renamed in place */
+    json::getObject(&b)[3].svKey = "renamed";
+    CHECK(json::searchObject(&b, "renamed", &idx) == &json::getObject(&b)[3]);
+    CHECK(json::getLong(json::searchObject(&b, key(230), &idx)) == 230);
+
+    idx.destroy();
+}
+
+int
+main()
+{
+    adt::PoolAllocator pool;
+
+    testLookup(&pool);
+    testDuplicates(&pool);
+    testPushAfterIndex(&pool);
+    testShrink(&pool);
+    testStale(&pool);
+
+    pool.freeAll();
+
+    if (s_nFailed) CERR("keys: %d checks failed\n", s_nFailed);
+    return s_nFailed != 0;
+}